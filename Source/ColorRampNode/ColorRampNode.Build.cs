@@ -28,6 +28,7 @@ public class ColorRampNode : ModuleRules
 			new string[]
 			{
 				"Core",
+				"ColorRampRuntime",
 				// ... add other public dependencies that you statically link with here ...
 			}
 			);
@@ -38,6 +39,8 @@ public class ColorRampNode : ModuleRules
 			{
 				"CoreUObject",
 				"Engine",
+				"DeveloperSettings",
+				"DerivedDataCache",
 				"Slate",
 				"SlateCore",
 				"AssetTools",
@@ -0,0 +1,128 @@
+﻿#include "ColorRampBakeCommandlet.h"
+
+#include "AssetRegistry/AssetRegistryModule.h"
+#include "Engine/Texture2D.h"
+#include "Materials/Material.h"
+#include "Materials/MaterialFunction.h"
+#include "Misc/PackageName.h"
+#include "UObject/SavePackage.h"
+#include "MaterialExpressionColorRamp.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogColorRampBake, Log, All);
+
+UColorRampBakeCommandlet::UColorRampBakeCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+}
+
+static bool SaveRampPackage(UPackage* Package)
+{
+	const FString Filename = FPackageName::LongPackageNameToFilename(Package->GetName(), FPackageName::GetAssetPackageExtension());
+
+	FSavePackageArgs SaveArgs;
+	SaveArgs.TopLevelFlags = RF_Public | RF_Standalone;
+	SaveArgs.SaveFlags = SAVE_NoError;
+	return UPackage::SavePackage(Package, nullptr, *Filename, SaveArgs);
+}
+
+int32 UColorRampBakeCommandlet::Main(const FString& Params)
+{
+	const double StartTime = FPlatformTime::Seconds();
+
+	FString PackagePath;
+	FParse::Value(*Params, TEXT("PackagePath="), PackagePath);
+	const bool bSave = !FParse::Param(*Params, TEXT("NoSave"));
+
+	IAssetRegistry& AssetRegistry = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry").Get();
+	AssetRegistry.SearchAllAssets(true);
+
+	// Only packages importing this module's classes can hold a ColorRamp node.
+	TArray<FName> Referencers;
+	AssetRegistry.GetReferencers(FName(TEXT("/Script/ColorRampNode")), Referencers);
+	Referencers.Sort(FNameLexicalLess());
+
+	TArray<UMaterialExpressionColorRamp*> Ramps;
+	int32 NumAssets = 0;
+	for (FName PackageName : Referencers)
+	{
+		if (!PackagePath.IsEmpty() && !PackageName.ToString().StartsWith(PackagePath))
+		{
+			continue;
+		}
+
+		TArray<FAssetData> Assets;
+		AssetRegistry.GetAssetsByPackageName(PackageName, Assets);
+		for (const FAssetData& AssetData : Assets)
+		{
+			UClass* AssetClass = AssetData.GetClass();
+			if (!AssetClass || !(AssetClass->IsChildOf<UMaterial>() || AssetClass->IsChildOf<UMaterialFunction>()))
+			{
+				continue;
+			}
+
+			UMaterialExpressionColorRamp::GetRamps(AssetData.GetAsset(), Ramps);
+			++NumAssets;
+		}
+	}
+
+	const double LoadTime = FPlatformTime::Seconds();
+
+	// Distinct ramps are baked in parallel, then textures are created on the game thread in load order.
+	TArray<UTexture2D*> OldTextures;
+	for (UMaterialExpressionColorRamp* Ramp : Ramps)
+	{
+		OldTextures.Add(Ramp->GetRampTexture());
+	}
+
+	const int32 NumBaked = UMaterialExpressionColorRamp::RefreshRamps(Ramps);
+
+	TSet<UPackage*> PackagesToSave;
+	for (int32 i = 0; i < Ramps.Num(); ++i)
+	{
+		// Transient textures have no package of their own to save.
+		UTexture2D* Texture = Ramps[i]->GetRampTexture();
+		if (Texture && !Texture->HasAnyFlags(RF_Transient))
+		{
+			PackagesToSave.Add(Texture->GetPackage());
+		}
+		if (Texture != OldTextures[i] && Ramps[i]->GetAssetOwner())
+		{
+			PackagesToSave.Add(Ramps[i]->GetAssetOwner()->GetPackage());
+		}
+	}
+
+	const double BakeTime = FPlatformTime::Seconds();
+
+	int32 NumSaved = 0;
+	int32 NumFailed = 0;
+	if (bSave)
+	{
+		TArray<UPackage*> SortedPackages = PackagesToSave.Array();
+		SortedPackages.Sort([](const UPackage& A, const UPackage& B) { return A.GetFName().LexicalLess(B.GetFName()); });
+
+		for (UPackage* Package : SortedPackages)
+		{
+			if (SaveRampPackage(Package))
+			{
+				++NumSaved;
+			}
+			else
+			{
+				++NumFailed;
+				UE_LOG(LogColorRampBake, Error, TEXT("Failed to save %s"), *Package->GetName());
+			}
+		}
+	}
+
+	const double EndTime = FPlatformTime::Seconds();
+
+	UE_LOG(LogColorRampBake, Display, TEXT("%d ramps in %d assets, %d distinct textures baked, %d packages saved, %d failed."),
+		Ramps.Num(), NumAssets, NumBaked, NumSaved, NumFailed);
+	UE_LOG(LogColorRampBake, Display, TEXT("Load %.2fs, bake %.2fs, save %.2fs, total %.2fs."),
+		LoadTime - StartTime, BakeTime - LoadTime, EndTime - BakeTime, EndTime - StartTime);
+
+	return NumFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,25 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+
+#include "ColorRampBakeCommandlet.generated.h"
+
+/**
+ * Re-bakes the textures of every ColorRamp node in the project and saves them.
+ *
+ * UnrealEditor-Cmd <Project> -run=ColorRampBake [-PackagePath=/Game/Path] [-NoSave] -nullrhi
+ *
+ * Distinct ramps are baked in parallel, textures are created and packages saved in a fixed order
+ * so repeated runs write the same files.
+ */
+UCLASS()
+class UColorRampBakeCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UColorRampBakeCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,270 @@
+﻿#include "ColorRampBenchmarkCommandlet.h"
+
+#include "Curves/CurveLinearColor.h"
+#include "HAL/IConsoleManager.h"
+#include "Materials/Material.h"
+#include "Math/RandomStream.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "SCurveEditor.h"
+#include "ColorRampEvaluator.h"
+#include "ColorRampNodeSettings.h"
+#include "MaterialExpressionColorRamp.h"
+#include "SCustomColorGradientEditor.h"
+#include <atomic>
+
+DEFINE_LOG_CATEGORY_STATIC(LogColorRampBenchmark, Log, All);
+
+// Forwards to the engine allocator, counting the allocations made while installed as GMalloc.
+class FCountingMalloc final : public FMalloc
+{
+public:
+	explicit FCountingMalloc(FMalloc* InInner) : Inner(InInner) {}
+
+	virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+	{
+		NumAllocs.fetch_add(1, std::memory_order_relaxed);
+		return Inner->Malloc(Count, Alignment);
+	}
+
+	virtual void* TryMalloc(SIZE_T Count, uint32 Alignment) override
+	{
+		NumAllocs.fetch_add(1, std::memory_order_relaxed);
+		return Inner->TryMalloc(Count, Alignment);
+	}
+
+	// Growing containers reallocate, those count as allocations too.
+	virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+	{
+		if (Count > 0)
+		{
+			NumAllocs.fetch_add(1, std::memory_order_relaxed);
+		}
+		return Inner->Realloc(Original, Count, Alignment);
+	}
+
+	virtual void* TryRealloc(void* Original, SIZE_T Count, uint32 Alignment) override
+	{
+		if (Count > 0)
+		{
+			NumAllocs.fetch_add(1, std::memory_order_relaxed);
+		}
+		return Inner->TryRealloc(Original, Count, Alignment);
+	}
+
+	virtual void Free(void* Original) override { Inner->Free(Original); }
+	virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override { return Inner->QuantizeSize(Count, Alignment); }
+	virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return Inner->GetAllocationSize(Original, SizeOut); }
+	virtual void Trim(bool bTrimThreadCaches) override { Inner->Trim(bTrimThreadCaches); }
+	virtual void SetupTLSCachesOnCurrentThread() override { Inner->SetupTLSCachesOnCurrentThread(); }
+	virtual void ClearAndDisableTLSCachesOnCurrentThread() override { Inner->ClearAndDisableTLSCachesOnCurrentThread(); }
+	virtual bool IsInternallyThreadSafe() const override { return Inner->IsInternallyThreadSafe(); }
+	virtual bool ValidateHeap() override { return Inner->ValidateHeap(); }
+	virtual const TCHAR* GetDescriptiveName() override { return Inner->GetDescriptiveName(); }
+
+	uint64 GetNumAllocs() const { return NumAllocs.load(std::memory_order_relaxed); }
+
+private:
+	FMalloc* Inner;
+	std::atomic<uint64> NumAllocs{0};
+};
+
+UColorRampBenchmarkCommandlet::UColorRampBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+}
+
+// Keeps the results of timed lookups alive.
+static volatile uint32 BenchmarkSink = 0;
+
+// Parses a comma separated list of integers, Default if the switch is missing.
+static TArray<int32> ParseIntList(const FString& Params, const TCHAR* Match, TArray<int32> Default)
+{
+	FString List;
+	if (!FParse::Value(*Params, Match, List, false))
+	{
+		return Default;
+	}
+
+	TArray<FString> Items;
+	List.ParseIntoArray(Items, TEXT(","));
+
+	TArray<int32> Values;
+	for (const FString& Item : Items)
+	{
+		Values.Add(FCString::Atoi(*Item));
+	}
+	return Values;
+}
+
+// Evenly spaced stops with colors from a stream seeded by the stop count, the same on every run.
+static TArray<FGradientColorPos> MakeStops(int32 NumStops)
+{
+	FRandomStream Random(NumStops);
+
+	TArray<FGradientColorPos> Stops;
+	for (int32 i = 0; i < NumStops; ++i)
+	{
+		Stops.Add(FGradientColorPos(FLinearColor(Random.FRand(), Random.FRand(), Random.FRand(), 1.f), float(i) / float(NumStops - 1)));
+	}
+	return Stops;
+}
+
+// Runs Body Iterations times and appends a row with its timing and allocation percentiles to Csv.
+static void Measure(FString& Csv, const TCHAR* Case, const FString& Config, int32 Iterations, const FCountingMalloc& Counter, TFunctionRef<void()> Body)
+{
+	TArray<double> Times;
+	TArray<uint64> Allocs;
+	for (int32 i = 0; i < Iterations; ++i)
+	{
+		const uint64 StartAllocs = Counter.GetNumAllocs();
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		Body();
+		Times.Add(FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles));
+		Allocs.Add(Counter.GetNumAllocs() - StartAllocs);
+	}
+
+	Times.Sort();
+	Allocs.Sort();
+	const int32 Median = Iterations / 2;
+	const int32 P99 = FMath::Min(Iterations * 99 / 100, Iterations - 1);
+
+	Csv += FString::Printf(TEXT("%s,%s,%d,%.4f,%.4f,%llu\n"), Case, *Config, Iterations, Times[Median], Times[P99], Allocs[Median]);
+}
+
+int32 UColorRampBenchmarkCommandlet::Main(const FString& Params)
+{
+	const TArray<int32> StopCounts = ParseIntList(Params, TEXT("Stops="), { 2, 4, 8, 16, 32, 64, 128, 256 });
+	const TArray<int32> Resolutions = ParseIntList(Params, TEXT("Resolutions="), { 64, 256, 1024, 4096, 16384 });
+
+	int32 Iterations = 20;
+	FParse::Value(*Params, TEXT("Iterations="), Iterations);
+	Iterations = FMath::Max(Iterations, 1);
+
+	FString OutputPath = FPaths::ProjectSavedDir() / TEXT("ColorRampBenchmark.csv");
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+
+	// Transient ramps create no packages, without the DDC every refresh bakes.
+	UColorRampNodeSettings* Settings = GetMutableDefault<UColorRampNodeSettings>();
+	const TEnumAsByte<EColorRampStorage> OldStorage = Settings->RampStorage;
+	Settings->RampStorage = CRS_TRANSIENT;
+
+	IConsoleVariable* UseDDC = IConsoleManager::Get().FindConsoleVariable(TEXT("ColorRamp.UseDDC"));
+	const bool bOldUseDDC = UseDDC && UseDDC->GetBool();
+	if (UseDDC)
+	{
+		UseDDC->Set(false, ECVF_SetByCode);
+	}
+
+	// Never destroyed, a thread may still hold it after GMalloc is restored.
+	FMalloc* EngineMalloc = GMalloc;
+	static FCountingMalloc* Counter = new FCountingMalloc(EngineMalloc);
+	GMalloc = Counter;
+
+	FString Csv = TEXT("Case,RampType,Stops,Resolution,Iterations,MedianMs,P99Ms,MedianAllocs\n");
+	int32 NumConfigs = 0;
+
+	for (EColorRampType RampType : { CRT_LINEAR, CRT_CONSTANT })
+	{
+		for (int32 NumStops : StopCounts)
+		{
+			for (int32 Resolution : Resolutions)
+			{
+				if (NumStops < 2 || Resolution < 1)
+				{
+					continue;
+				}
+
+				const FString Config = FString::Printf(TEXT("%s,%d,%d"), RampType == CRT_LINEAR ? TEXT("Linear") : TEXT("Constant"), NumStops, Resolution);
+
+				UMaterial* Material = NewObject<UMaterial>(GetTransientPackage(), NAME_None, RF_Transient);
+				UMaterialExpressionColorRamp* Ramp = NewObject<UMaterialExpressionColorRamp>(Material);
+				Ramp->Material = Material;
+				Ramp->RampType = RampType;
+				Ramp->EvalMode = CREM_TEXTURE;
+				Ramp->Format = CRF_BGRA8;
+				Ramp->Resolution = Resolution;
+				Ramp->ColorStamp.ColorPosArray = MakeStops(NumStops);
+				Ramp->EnsureRampResources();
+
+				// Texel generation of GenerateRampTex.
+				TArray<uint8> Pixels;
+				Pixels.SetNumUninitialized(Resolution * 4);
+				Measure(Csv, TEXT("Bake"), Config, Iterations, *Counter, [Ramp, &Pixels, Resolution]()
+				{
+					Ramp->BakeRampPixels(Pixels.GetData(), Resolution, CRF_BGRA8);
+				});
+
+				// Random access lookups, one per texel.
+				const FColorRampEvaluator Evaluator(Ramp->ColorStamp.ColorPosArray, RampType, true);
+				Measure(Csv, TEXT("Evaluate"), Config, Iterations, *Counter, [&Evaluator, Resolution]()
+				{
+					uint32 Checksum = 0;
+					for (int32 x = 0; x < Resolution; ++x)
+					{
+						Checksum += Evaluator.Evaluate(float(x) / float(Resolution)).DWColor();
+					}
+					BenchmarkSink = Checksum;
+				});
+
+				// Edit in the gradient widget: the curve changes, the node syncs and re-bakes.
+				int32 Edit = 0;
+				Measure(Csv, TEXT("RefreshParameters"), Config, Iterations, *Counter, [Ramp, RampType, &Edit]()
+				{
+					Ramp->ColorStamp.ColorPosArray[0].Color.R = float(++Edit % 1000) / 1000.f;
+					Ramp->ColorStamp.SetCurveLinearColor(Ramp->GetCurve(), RampType);
+					Ramp->RefreshParameters(nullptr, false);
+				});
+
+				// What Compile pays on an unchanged ramp: the ramp key is hashed and nothing is baked.
+				Measure(Csv, TEXT("UpToDateCheck"), Config, Iterations, *Counter, [Ramp]()
+				{
+					Ramp->EnsureRampResources();
+				});
+
+				// Gradient SCustomColorGradientEditor::OnPaint rebuilds after an edit, for an 800 unit wide widget.
+				// Slate drawing itself needs a renderer and is not covered.
+				{
+					TSharedRef<SCustomColorGradientEditor> GradientEditor = SNew(SCustomColorGradientEditor)
+						.ViewMinInput(0.0f)
+						.ViewMaxInput(1.0f)
+						.IsSRGB(true);
+					GradientEditor->SetCurveOwner(Ramp->GetCurve());
+
+					const FTrackScaleInfo ScaleInfo(0.0f, 1.0f, 0.0f, 1.0f, FVector2D(800.0f, 55.0f));
+					Measure(Csv, TEXT("PaintCache"), Config, Iterations, *Counter, [&GradientEditor, &ScaleInfo]()
+					{
+						GradientEditor->PaintCache.bValid = false;
+						GradientEditor->UpdatePaintCache(ScaleInfo, 800);
+					});
+				}
+
+				Material->MarkAsGarbage();
+				CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+				++NumConfigs;
+
+				UE_LOG(LogColorRampBenchmark, Display, TEXT("%s done."), *Config);
+			}
+		}
+	}
+
+	GMalloc = EngineMalloc;
+
+	if (UseDDC)
+	{
+		UseDDC->Set(bOldUseDDC, ECVF_SetByCode);
+	}
+	Settings->RampStorage = OldStorage;
+
+	if (!FFileHelper::SaveStringToFile(Csv, *OutputPath))
+	{
+		UE_LOG(LogColorRampBenchmark, Error, TEXT("Failed to write %s"), *OutputPath);
+		return 1;
+	}
+
+	UE_LOG(LogColorRampBenchmark, Display, TEXT("%d configurations written to %s"), NumConfigs, *OutputPath);
+	return 0;
+}
@@ -0,0 +1,26 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+
+#include "ColorRampBenchmarkCommandlet.generated.h"
+
+/**
+ * Times the ramp hot paths over a sweep of stop counts, resolutions and ramp types, and writes a CSV row per case.
+ *
+ * UnrealEditor-Cmd <Project> -run=ColorRampBenchmark [-Stops=2,4,8] [-Resolutions=64,1024] [-Iterations=20] [-Output=File.csv] -nullrhi -unattended
+ *
+ * Rows hold the median and 99th percentile time in milliseconds and the median number of
+ * allocations made through GMalloc per iteration. Ramps are transient and the DDC is not used,
+ * so every refresh bakes.
+ */
+UCLASS()
+class UColorRampBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UColorRampBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
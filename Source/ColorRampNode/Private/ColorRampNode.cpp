@@ -2,6 +2,7 @@
 
 #include "ColorRampNode.h"
 #include "GradientColorPosDetailCustomization.h"
+#include "ColorRampTextureCache.h"
 
 #define LOCTEXT_NAMESPACE "FColorRampNodeModule"
 
@@ -19,6 +20,8 @@ void FColorRampNodeModule::ShutdownModule()
 {
 	// This function may be called during shutdown to clean up your module.  For modules that support dynamic reloading,
 	// we call this function before unloading the module.
+
+	FColorRampTextureCache::TearDown();
 }
 
 #undef LOCTEXT_NAMESPACE
@@ -0,0 +1,45 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DeveloperSettings.h"
+
+#include "ColorRampNodeSettings.generated.h"
+
+UENUM()
+enum EColorRampStorage
+{
+	CRS_ASSET		UMETA(DisplayName = "Asset", ToolTip = "Ramp textures and curves are assets in /Game/ packages."),
+	CRS_TRANSIENT	UMETA(DisplayName = "Transient", ToolTip = "Ramp textures and curves are transient objects, no packages or asset registry entries. Baked again after a load.")
+};
+
+UCLASS(config=ColorRampNode, defaultconfig, meta=(DisplayName="Color Ramp Node"))
+class COLORRAMPNODE_API UColorRampNodeSettings : public UDeveloperSettings
+{
+	GENERATED_BODY()
+
+public:
+	/** Ramps in Auto eval mode with fewer stops than this are evaluated in the shader instead of sampling a texture. */
+	UPROPERTY(config, EditAnywhere, Category=Shader, meta=(ClampMin=2, UIMin=2, UIMax=16))
+	int32 AutoALUStopLimit = 5;
+
+	/** Largest channel error allowed between a ramp with Auto Resolution and its filtered texture. The default is half an 8 bit step. */
+	UPROPERTY(config, EditAnywhere, Category=Shader, meta=(ClampMin=0, UIMin=0, UIMax=0.05))
+	float AutoResolutionTolerance = 0.002f;
+
+	/** Ramp refreshes per second while a stop or alpha value is dragged in the gradient widget. 0 refreshes on every change. The final value is always applied on release. */
+	UPROPERTY(config, EditAnywhere, Category=Editor, meta=(ClampMin=0, UIMin=0, UIMax=120))
+	float GradientNotifyRate = 30.f;
+
+	/** Where ramp textures and curves live. Only affects textures and curves created after a change. */
+	UPROPERTY(config, EditAnywhere, Category=Editor)
+	TEnumAsByte<EColorRampStorage> RampStorage = CRS_ASSET;
+
+	/**
+	 * Bake missing or stale ramp textures while cooking, as cook-only objects saved with the cooked material.
+	 * Source packages are never written. If off, the cook uses the saved ramp textures as they are.
+	 */
+	UPROPERTY(config, EditAnywhere, Category=Cook)
+	bool bBakeOnCook = true;
+
+	virtual FName GetCategoryName() const override { return TEXT("Plugins"); }
+};
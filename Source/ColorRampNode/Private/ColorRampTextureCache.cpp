@@ -0,0 +1,141 @@
+﻿#include "ColorRampTextureCache.h"
+
+#include "Engine/Texture2D.h"
+#include "Curves/CurveLinearColor.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/Package.h"
+#include "UObject/UObjectIterator.h"
+
+FColorRampTextureCache& FColorRampTextureCache::Get()
+{
+	return TLazySingleton<FColorRampTextureCache>::Get();
+}
+
+void FColorRampTextureCache::TearDown()
+{
+	TLazySingleton<FColorRampTextureCache>::TearDown();
+}
+
+UTexture2D* FColorRampTextureCache::Acquire(const FSHAHash& Key, TFunctionRef<UTexture2D*()> CreateTexture)
+{
+	FEntry& Entry = Entries.FindOrAdd(Key);
+	if (!IsValid(Entry.Texture))
+	{
+		Entry.Texture = CreateTexture();
+	}
+
+	++Entry.RefCount;
+	return Entry.Texture;
+}
+
+void FColorRampTextureCache::Release(const FSHAHash& Key)
+{
+	FEntry* Entry = Entries.Find(Key);
+	if (Entry && --Entry->RefCount <= 0)
+	{
+		// Standalone assets are never collected, let GC take the texture once the last node stops referencing it.
+		if (UTexture2D* Texture = Entry->Texture)
+		{
+			Texture->RemoveFromRoot();
+			Texture->ClearFlags(RF_Standalone);
+
+			// Nothing left to save in a package that was never written to disk, unless another ramp texture
+			// still lives in it. Runs from BeginDestroy during GC, only in memory state is looked at.
+			UPackage* Package = Texture->GetPackage();
+			if (Package != GetTransientPackage() && Package->HasAnyPackageFlags(PKG_NewlyCreated) && !HoldsTextureInPackage(Package, Texture))
+			{
+				Package->SetDirtyFlag(false);
+			}
+		}
+
+		Entries.Remove(Key);
+	}
+}
+
+void FColorRampTextureCache::Rekey(const FSHAHash& OldKey, const FSHAHash& NewKey)
+{
+	check(!Entries.Contains(NewKey));
+
+	FEntry Entry;
+	if (Entries.RemoveAndCopyValue(OldKey, Entry))
+	{
+		Entries.Add(NewKey, Entry);
+	}
+}
+
+int32 FColorRampTextureCache::GetRefCount(const FSHAHash& Key) const
+{
+	const FEntry* Entry = Entries.Find(Key);
+	return Entry ? Entry->RefCount : 0;
+}
+
+bool FColorRampTextureCache::HoldsTexture(const UTexture2D* Texture) const
+{
+	for (const TPair<FSHAHash, FEntry>& Pair : Entries)
+	{
+		if (Pair.Value.Texture == Texture)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool FColorRampTextureCache::HoldsTextureInPackage(const UPackage* Package, const UTexture2D* Except) const
+{
+	for (const TPair<FSHAHash, FEntry>& Pair : Entries)
+	{
+		const UTexture2D* Texture = Pair.Value.Texture;
+		if (Texture && Texture != Except && Texture->GetPackage() == Package)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void FColorRampTextureCache::AddReferencedObjects(FReferenceCollector& Collector)
+{
+	for (TPair<FSHAHash, FEntry>& Pair : Entries)
+	{
+		Collector.AddReferencedObject(Pair.Value.Texture);
+	}
+}
+
+static void DumpColorRampStats(FOutputDevice& Ar)
+{
+	int32 NumTextures = 0;
+	int32 NumRootedTextures = 0;
+	SIZE_T TextureBytes = 0;
+	for (TObjectIterator<UTexture2D> It; It; ++It)
+	{
+		if (It->GetName().StartsWith(TEXT("ColorRampTempTex_")))
+		{
+			++NumTextures;
+			NumRootedTextures += It->IsRooted() ? 1 : 0;
+			TextureBytes += It->GetResourceSizeBytes(EResourceSizeMode::EstimatedTotal);
+		}
+	}
+
+	int32 NumCurves = 0;
+	int32 NumRootedCurves = 0;
+	SIZE_T CurveBytes = 0;
+	for (TObjectIterator<UCurveLinearColor> It; It; ++It)
+	{
+		if (It->GetName().StartsWith(TEXT("ColorRampTempCurve_")))
+		{
+			++NumCurves;
+			NumRootedCurves += It->IsRooted() ? 1 : 0;
+			CurveBytes += It->GetResourceSizeBytes(EResourceSizeMode::EstimatedTotal);
+		}
+	}
+
+	Ar.Logf(TEXT("ColorRamp textures: %d live (%d rooted), %llu bytes"), NumTextures, NumRootedTextures, (uint64)TextureBytes);
+	Ar.Logf(TEXT("ColorRamp curves: %d live (%d rooted), %llu bytes"), NumCurves, NumRootedCurves, (uint64)CurveBytes);
+	Ar.Logf(TEXT("ColorRamp cache: %d shared textures"), FColorRampTextureCache::Get().Num());
+}
+
+static FAutoConsoleCommandWithOutputDevice ColorRampStatsCommand(
+	TEXT("ColorRamp.Stats"),
+	TEXT("Reports live ColorRamp textures and curves and the memory they use."),
+	FConsoleCommandWithOutputDeviceDelegate::CreateStatic(&DumpColorRampStats));
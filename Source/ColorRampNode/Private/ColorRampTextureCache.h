@@ -0,0 +1,65 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/SecureHash.h"
+#include "Misc/LazySingleton.h"
+#include "UObject/GCObject.h"
+
+class UTexture2D;
+class UPackage;
+
+/**
+ * Content addressed store of baked ramp textures.
+ * Nodes whose ramps hash to the same key share one ref-counted texture,
+ * so texture count follows the number of distinct ramps instead of the number of nodes.
+ */
+class FColorRampTextureCache : public FGCObject
+{
+public:
+	static FColorRampTextureCache& Get();
+	static void TearDown();
+
+	/**
+	 * Adds a reference to the texture baked for Key.
+	 *
+	 * @param Key			Hash of the ramp contents and bake settings
+	 * @param CreateTexture	Bakes the texture, only called if no one holds Key yet
+	 * @return				The shared texture
+	 */
+	UTexture2D* Acquire(const FSHAHash& Key, TFunctionRef<UTexture2D*()> CreateTexture);
+
+	/** Drops a reference taken by Acquire. */
+	void Release(const FSHAHash& Key);
+
+	/** Moves the texture of OldKey to NewKey after its texels were rewritten in place. NewKey must not be in use. */
+	void Rekey(const FSHAHash& OldKey, const FSHAHash& NewKey);
+
+	bool Contains(const FSHAHash& Key) const { return Entries.Contains(Key); }
+
+	int32 GetRefCount(const FSHAHash& Key) const;
+
+	/** True if Texture is held under any key. */
+	bool HoldsTexture(const UTexture2D* Texture) const;
+
+	/** True if a texture other than Except is held in Package. */
+	bool HoldsTextureInPackage(const UPackage* Package, const UTexture2D* Except) const;
+
+	int32 Num() const { return Entries.Num(); }
+
+	/** FGCObject interface */
+	virtual void AddReferencedObjects(FReferenceCollector& Collector) override;
+	virtual FString GetReferencerName() const override { return TEXT("FColorRampTextureCache"); }
+
+private:
+	friend class FLazySingleton;
+
+	FColorRampTextureCache() = default;
+
+	struct FEntry
+	{
+		TObjectPtr<UTexture2D> Texture;
+		int32 RefCount = 0;
+	};
+
+	TMap<FSHAHash, FEntry> Entries;
+};
@@ -26,12 +26,17 @@ void FGradientColorPosDetailCustomization::CustomizeHeader(
 
 	if (IsValid(MaterialExpressionColorRamp))
 	{
+		// Nodes create their curve on first use.
+		MaterialExpressionColorRamp->EnsureRampResources();
+
 		UCurveLinearColor* Curve = MaterialExpressionColorRamp->GetCurve();
 		if (Curve)
 		{
 			GradientEditor->SetCurveOwner(Curve);
 			GradientEditor->SetUseSRGB(&MaterialExpressionColorRamp->bSRGB);
-			MaterialExpressionColorRamp->RefreshTexture();
+			GradientEditor->SetCurveChangeSerial(TAttribute<uint32>::Create(TAttribute<uint32>::FGetter::CreateUObject(
+				MaterialExpressionColorRamp, &UMaterialExpressionColorRamp::GetCurveChangeSerial)));
+			MaterialExpressionColorRamp->RefreshTexture(nullptr, false);
 		}
 	}
 	
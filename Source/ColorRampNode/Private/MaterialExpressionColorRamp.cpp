@@ -1,19 +1,125 @@
 ﻿#include "MaterialExpressionColorRamp.h"
 
 #include "MaterialCompiler.h"
+#include "MaterialTypes.h"
+#include "Materials/Material.h"
+#include "Materials/MaterialFunction.h"
 #include "AssetRegistry/AssetRegistryModule.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "Algo/AllOf.h"
 #include "Curves/CurveLinearColor.h"
+#include "Editor.h"
+#include "Editor/TransBuffer.h"
+#include "Math/Float16Color.h"
+#include "DerivedDataCacheInterface.h"
+#include "HAL/IConsoleManager.h"
+#include "Serialization/MemoryWriter.h"
+#include "ColorRampTextureCache.h"
+#include "ColorRampNodeSettings.h"
+#include "ColorRampEvaluator.h"
 
 #define LOCTEXT_NAMESPACE "MateiralExpressionColorRamp"
 
-// Custom Struct
+static TAutoConsoleVariable<bool> CVarColorRampAsyncBake(
+	TEXT("ColorRamp.AsyncBake"),
+	true,
+	TEXT("Bake ramps edited in the gradient widget on a worker thread. 0 bakes them synchronously."));
+
+static TAutoConsoleVariable<bool> CVarColorRampUseDDC(
+	TEXT("ColorRamp.UseDDC"),
+	true,
+	TEXT("Share baked ramp texels through the derived data cache."));
+
+// Widest span of a stop edit patched on the game thread instead of baked on a worker.
+static constexpr int32 SyncPartialBakeTexels = 4096;
+
+// Change to invalidate all ramp texels in the derived data cache.
+#define COLORRAMP_DDC_VERSION TEXT("3F6B2D8E1A0C4E57B9D2A1C7E4F08B36")
+
+/**
+ * Fills NumBytes of OutPixels with the texels of Key from the derived data cache.
+ * On a miss they are baked and stored for other sessions and machines. Safe to call from worker threads.
+ * Interactive edits pass bUseDDC false, a synchronous cache round trip costs more than baking one ramp.
+ */
+static void GetCachedRampPixels(const FSHAHash& Key, int32 NumBytes, TArray<uint8>& OutPixels, bool bUseDDC, TFunctionRef<void(uint8*)> Bake)
+{
+	if (!bUseDDC || !CVarColorRampUseDDC.GetValueOnAnyThread())
+	{
+		OutPixels.SetNumUninitialized(NumBytes);
+		Bake(OutPixels.GetData());
+		return;
+	}
+
+	const FString CacheKey = FDerivedDataCacheInterface::BuildCacheKey(TEXT("COLORRAMP"), COLORRAMP_DDC_VERSION, *Key.ToString());
+	if (GetDerivedDataCacheRef().GetSynchronous(*CacheKey, OutPixels, Key.ToString()) && OutPixels.Num() == NumBytes)
+	{
+		return;
+	}
+
+	OutPixels.SetNumUninitialized(NumBytes);
+	Bake(OutPixels.GetData());
+	GetDerivedDataCacheRef().Put(*CacheKey, OutPixels, Key.ToString());
+}
+
+// Texture formats behind each EColorRampFormat.
+struct FRampFormatInfo
+{
+	ETextureSourceFormat SourceFormat;
+	EPixelFormat PixelFormat;
+	TextureCompressionSettings Compression;
+	EMaterialSamplerType SamplerType;
+	int32 BytesPerTexel;
+};
+
+static const FRampFormatInfo& GetRampFormatInfo(EColorRampFormat Format)
+{
+	static const FRampFormatInfo BGRA8 = { TSF_BGRA8, PF_B8G8R8A8, TC_VectorDisplacementmap, SAMPLERTYPE_LinearColor, 4 };
+	static const FRampFormatInfo R8 = { TSF_G8, PF_G8, TC_Grayscale, SAMPLERTYPE_LinearGrayscale, 1 };
+	static const FRampFormatInfo RGBA16F = { TSF_RGBA16F, PF_FloatRGBA, TC_HDR, SAMPLERTYPE_LinearColor, 8 };
+
+	switch (Format)
+	{
+	case CRF_R8:		return R8;
+	case CRF_RGBA16F:	return RGBA16F;
+	default:			return BGRA8;
+	}
+}
 
-FGradientColorPos::FGradientColorPos(FLinearColor InColor, float InPosition)
+// Fills texels [Begin, End) of a Width texel row of Format from the stops of Evaluator.
+static void BakeEvaluatorTexels(const FColorRampEvaluator& Evaluator, int32 Width, const FColorRampTexelMapping& Mapping, EColorRampFormat Format, uint8* Pixels, int32 Begin, int32 End)
 {
-	Color = InColor;
-	Position = InPosition;
+	if (Format == CRF_R8)
+	{
+		// Only chosen for grayscale ramps, where red holds the value.
+		TArray<FColor> Texels;
+		Texels.SetNumUninitialized(Width);
+		Evaluator.BakeSpan(Begin, End, Mapping, Texels.GetData());
+		for (int32 x = Begin; x < End; x++)
+		{
+			Pixels[x] = Texels[x].R;
+		}
+	}
+	else if (Format == CRF_RGBA16F)
+	{
+		TArray<FLinearColor> Colors;
+		Colors.SetNumUninitialized(Width);
+		Evaluator.BakeLinear(Begin, End, Mapping, Colors.GetData());
+		FFloat16Color* Texels = reinterpret_cast<FFloat16Color*>(Pixels);
+		for (int32 x = Begin; x < End; x++)
+		{
+			Texels[x] = FFloat16Color(Colors[x]);
+		}
+	}
+	else
+	{
+		// FColor is laid out as BGRA8, texels are written in place.
+		Evaluator.BakeSpan(Begin, End, Mapping, reinterpret_cast<FColor*>(Pixels));
+	}
 }
 
+// Custom Struct
+
 // Init black to white default gradient color.
 FColorStamp::FColorStamp()
 {
@@ -87,8 +193,6 @@ bool FColorStamp::SetFromCurve(TObjectPtr<UCurveLinearColor> CurveLinearColor)
 UMaterialExpressionColorRamp::UMaterialExpressionColorRamp(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
 {
 	MenuCategories.Add(LOCTEXT("MateiralExpressionColorRampCategory", "ColorRamp"));
-
-	RefreshParameters();
 }
 
 TObjectPtr<UCurveLinearColor> UMaterialExpressionColorRamp::GetCurve()
@@ -96,10 +200,137 @@ TObjectPtr<UCurveLinearColor> UMaterialExpressionColorRamp::GetCurve()
 	return TempCurvePtr;
 }
 
-void UMaterialExpressionColorRamp::RefreshTexture()
+void UMaterialExpressionColorRamp::SyncColorStamp()
 {
+	ColorStamp.ColorPosArray.Sort();
 	bValidCurve = ColorStamp.SetFromCurve(TempCurvePtr);
-	GenerateRampTex();
+}
+
+void UMaterialExpressionColorRamp::RefreshTexture(const TArray<uint8>* BakedPixels, bool bUseDDC)
+{
+	SyncColorStamp();
+
+	// Any bake still in flight is stale now.
+	++(*LatestBakeSerial);
+
+	// ALU ramps do not sample a texture.
+	if (UseALU())
+	{
+		ReleaseRampTexture();
+		TempRampTexPtr = nullptr;
+		return;
+	}
+
+	if (UseAtlas())
+	{
+		RefreshAtlas(bUseDDC);
+		return;
+	}
+
+	// Nodes with identical ramps share one texture, named after its key.
+	const FSHAHash NewKey = ComputeRampKey();
+	if (NewKey == RampTexKey && IsValid(TempRampTexPtr))
+	{
+		return;
+	}
+
+	// While editing, the node usually is the only user of its texture. Rewrite it instead
+	// of creating a new package and texture for every change.
+	const FString NewTextureName = "ColorRampTempTex_" + NewKey.ToString();
+	FColorRampTextureCache& Cache = FColorRampTextureCache::Get();
+	if (RampTexKey != FSHAHash() && Cache.GetRefCount(RampTexKey) == 1 && CreatedRampTex.Get() == TempRampTexPtr
+		&& !Cache.Contains(NewKey) && CanRenameRampTexture(NewTextureName))
+	{
+		// A stop edit only changes the texels between its neighbours, the rest of the row is kept.
+		int32 Begin, End;
+		const bool bUpdated = (GetPartialBakeSpan(Begin, End) && UpdateRampTexSpan(TempRampTexPtr, NewKey, Begin, End, BakedPixels))
+			|| UpdateRampTexInPlace(TempRampTexPtr, NewKey, BakedPixels);
+		if (bUpdated)
+		{
+			RenameRampTexture(TempRampTexPtr, NewTextureName);
+			Cache.Rekey(RampTexKey, NewKey);
+			RampTexKey = NewKey;
+			RecordBakedRamp(NewKey);
+			return;
+		}
+	}
+
+	TempTextureName = NewTextureName;
+
+	// Acquire before releasing so an unchanged key is never dropped and re-baked.
+	TempRampTexPtr = Cache.Acquire(NewKey, [this, &NewKey, BakedPixels, bUseDDC]() { return GenerateRampTex(NewKey, BakedPixels, bUseDDC); });
+	ReleaseRampTexture();
+	RampTexKey = NewKey;
+	RecordBakedRamp(NewKey);
+}
+
+void UMaterialExpressionColorRamp::RecordBakedRamp(const FSHAHash& Key)
+{
+	// Custom curves are always baked whole.
+	BakedRamp.Key = bUseCustomCurveLinearColor ? FSHAHash() : Key;
+	BakedRamp.Stops = ColorStamp.ColorPosArray;
+	BakedRamp.Width = GetRampWidth();
+	BakedRamp.Format = GetRampFormat();
+	BakedRamp.RampType = RampType;
+	BakedRamp.bSRGB = bSRGB;
+	BakedRamp.bAutoResolution = UseAutoResolution();
+}
+
+bool UMaterialExpressionColorRamp::GetPartialBakeSpan(int32& OutBegin, int32& OutEnd) const
+{
+	if (BakedRamp.Key == FSHAHash() || BakedRamp.Key != RampTexKey || bUseCustomCurveLinearColor || !UsesRampTexture()
+		|| FColorRampTextureCache::Get().GetRefCount(RampTexKey) != 1 || CreatedRampTex.Get() != TempRampTexPtr)
+	{
+		return false;
+	}
+
+	const int32 Width = GetRampWidth();
+	if (BakedRamp.Width != Width || BakedRamp.Format != GetRampFormat() || BakedRamp.RampType != RampType
+		|| BakedRamp.bSRGB != bSRGB || BakedRamp.bAutoResolution != UseAutoResolution())
+	{
+		return false;
+	}
+
+	// Both lists are sorted, stops kept at either end bound the added, moved, removed or recolored ones.
+	const TArray<FGradientColorPos>& OldStops = BakedRamp.Stops;
+	const TArray<FGradientColorPos>& NewStops = ColorStamp.ColorPosArray;
+	auto SameStop = [](const FGradientColorPos& A, const FGradientColorPos& B) { return A.Position == B.Position && A.Color == B.Color; };
+
+	int32 First = 0;
+	while (First < OldStops.Num() && First < NewStops.Num() && SameStop(OldStops[First], NewStops[First]))
+	{
+		First++;
+	}
+
+	int32 OldLast = OldStops.Num() - 1;
+	int32 NewLast = NewStops.Num() - 1;
+	while (OldLast >= First && NewLast >= First && SameStop(OldStops[OldLast], NewStops[NewLast]))
+	{
+		OldLast--;
+		NewLast--;
+	}
+
+	// Same stops, the key changed for another reason.
+	if (OldLast < First && NewLast < First)
+	{
+		return false;
+	}
+
+	// Texels up to the kept stop before the edit and from the kept stop after it keep their color.
+	// A texel of margin on each side absorbs rounding of the time to texel conversion.
+	const FColorRampTexelMapping Mapping = GetTexelMapping(Width);
+	OutBegin = 0;
+	OutEnd = Width;
+	if (First > 0)
+	{
+		OutBegin = FMath::Clamp(FMath::FloorToInt(OldStops[First - 1].Position / Mapping.Step - Mapping.Offset) - 1, 0, Width);
+	}
+	if (OldLast + 1 < OldStops.Num())
+	{
+		OutEnd = FMath::Clamp(FMath::CeilToInt(OldStops[OldLast + 1].Position / Mapping.Step - Mapping.Offset) + 2, 0, Width);
+	}
+
+	return OutBegin < OutEnd;
 }
 
 void UMaterialExpressionColorRamp::GetCaption(TArray<FString>& OutCaptions) const
@@ -121,13 +352,39 @@ int32 UMaterialExpressionColorRamp::Compile(FMaterialCompiler* Compiler, int32 O
 			return Result;
 		}
 
-		RefreshParameters();
-		// if (!TempRampTexPtr || !TempCurvePtr || !OnUpdateCurveHandle.IsValid())
-		// {
-		// 	RefreshParameters();
-		// }
-		
-		Result = LinearRamp(Factor.Compile(Compiler), Compiler);
+		// Compile runs once per platform, feature level and quality permutation,
+		// only rebuild when the ramp changed since the last bake.
+		UTexture2D* GatheredTexture = TempRampTexPtr;
+		EnsureRampResources();
+
+		// The material gathers its textures through GetReferencedTexture before compiling, a texture created
+		// now cannot be sampled by this pass. PostLoad and the edit paths bake ahead of the gather, this is
+		// left for nodes that missed them, such as freshly placed or pasted ones.
+		if (!UseALU() && (!IsValid(TempRampTexPtr) || TempRampTexPtr != GatheredTexture))
+		{
+			if (IsRunningCookCommandlet())
+			{
+				return Compiler->Errorf(TEXT("Ramp texture was not baked before the material gathered its textures."));
+			}
+
+			// Once for all permutations, the next pass gathers the new texture.
+			if (!bGatherRecompileQueued)
+			{
+				bGatherRecompileQueued = true;
+				TWeakObjectPtr<UMaterialExpressionColorRamp> WeakThis(this);
+				AsyncTask(ENamedThreads::GameThread, [WeakThis]()
+				{
+					if (UMaterialExpressionColorRamp* Ramp = WeakThis.Get())
+					{
+						Ramp->bGatherRecompileQueued = false;
+						Ramp->RecompileOwner();
+					}
+				});
+			}
+			return Compiler->Errorf(TEXT("Ramp texture is being baked, the material recompiles once it is ready."));
+		}
+
+		Result = UseALU() ? ALURamp(Factor.Compile(Compiler), Compiler) : LinearRamp(Factor.Compile(Compiler), Compiler);
 
 		if (!bValidCurve)
 		{
@@ -142,10 +399,19 @@ int32 UMaterialExpressionColorRamp::Compile(FMaterialCompiler* Compiler, int32 O
 	return Result;
 }
 
+void UMaterialExpressionColorRamp::PostLoad()
+{
+	Super::PostLoad();
+
+	// The material post loads its expressions before it gathers their textures. Stale ramps are baked here
+	// so the material, and the cooked material, references their textures.
+	EnsureRampResources();
+}
+
 UObject* UMaterialExpressionColorRamp::GetReferencedTexture() const
 {
 	// return Super::GetReferencedTexture();
-	// if (IsValid(TempRampTexPtr))
+	// Never bakes, this runs while the material loads and saves. PostLoad and the edit paths bake ahead of it.
 	return TempRampTexPtr;
 }
 
@@ -153,215 +419,1051 @@ void UMaterialExpressionColorRamp::PostEditChangeProperty(FPropertyChangedEvent&
 {
 	Super::PostEditChangeProperty(PropertyChangedEvent);
 
-	RefreshParameters();
+	if (bIsParameter)
+	{
+		UpdateParameterGuid(false, true);
+	}
+
+	RefreshParameters(nullptr, false);
 
 	this->GetAssetOwner()->GetPackage()->MarkPackageDirty();
 }
 
-UMaterialExpressionColorRamp::~UMaterialExpressionColorRamp()
+bool UMaterialExpressionColorRamp::GetParameterValue(FMaterialParameterMetadata& OutMeta) const
 {
-	if (IsValid(TempRampTexPtr))
+	if (!bIsParameter)
 	{
-		TempRampTexPtr->RemoveFromRoot();
+		return false;
 	}
 
-	if (IsValid(TempCurvePtr))
-	{
-		TempCurvePtr->RemoveFromRoot();
-	}
+	// Defaults to the baked ramp, atlas ramps default to the material's atlas.
+	OutMeta.Value = TempRampTexPtr;
+	OutMeta.ExpressionGuid = ExpressionGUID;
+	return true;
+}
+
+void UMaterialExpressionColorRamp::BeginDestroy()
+{
+	ClearPendingRecompile();
+	ReleaseRampTexture();
+	ReleaseRampCurve();
+
+	Super::BeginDestroy();
 }
 
-void UMaterialExpressionColorRamp::RefreshParameters()
+
+void UMaterialExpressionColorRamp::RefreshParameters(const TArray<uint8>* BakedPixels, bool bUseDDC)
 {
 	if (IsValid(this->GetAssetOwner()))
 	{
-		TempTextureName = "ColorRampTempTex_" + this->GetAssetOwner()->GetName() + "_" + this->GetName();
 		TempCurveName = "ColorRampTempCurve_" + this->GetAssetOwner()->GetName() + "_" + this->GetName();
 	
-		ColorStamp.ColorPosArray.Sort();
-		RefreshTexture();
+		RefreshTexture(BakedPixels, bUseDDC);
 		if (!IsValid(TempCurvePtr) || !OnUpdateCurveHandle.IsValid())
 			GenerateRampCurve();
 
 		ColorStamp.SetCurveLinearColor(TempCurvePtr, RampType);
+		++CurveChangeSerial;
 	}
 }
 
-FColor UMaterialExpressionColorRamp::GetCurrentColor(int32 Pos)
+void UMaterialExpressionColorRamp::EnsureRampResources()
 {
-	float Time = float(Pos) / float(Resolution);
-	
-	if (!bUseCustomCurveLinearColor)
+	check(IsInGameThread());
+
+	if (!IsValid(GetAssetOwner()) || IsRampUpToDate())
 	{
-		for (int32 i = 0; i < ColorStamp.ColorPosArray.Num()-1; ++i)
-		{
-			if (Time <= ColorStamp.ColorPosArray[i].Position)
-			{
-				// if (RampType == CRT_LINEAR)
-				return ColorStamp.ColorPosArray[i].Color.ToFColor(!bSRGB);
-				// else if (RampType == CRT_CONSTANT)
-				// 	return ColorStamp.ColorPosArray[i].Color.ToFColor(true);
-			}
-			if (ColorStamp.ColorPosArray[i].Position < Time && Time <= ColorStamp.ColorPosArray[i+1].Position)
-			{
-				if (RampType == CRT_LINEAR)
-				{
-					float Progress = (Time - ColorStamp.ColorPosArray[i].Position) / (ColorStamp.ColorPosArray[i+1].Position - ColorStamp.ColorPosArray[i].Position);
-					FLinearColor Color = ColorStamp.ColorPosArray[i].Color * (1 - Progress) + ColorStamp.ColorPosArray[i+1].Color * Progress;
-					return Color.ToFColor(!bSRGB);
-				}
-				else if (RampType == CRT_CONSTANT)
-				{
-					return ColorStamp.ColorPosArray[i].Color.ToFColor(true);
-				}
-			}
-			// Last Color
-			if (ColorStamp.ColorPosArray[i+1].Position < Time && i+1 == ColorStamp.ColorPosArray.Num()-1)
-			{
-				// if (RampType == CRT_LINEAR)
-				return ColorStamp.ColorPosArray[i+1].Color.ToFColor(!bSRGB);
-			}
-		}
+		return;
 	}
-	else if (IsValid(CustomCurveLinearColor))
+
+	if (IsRunningCookCommandlet() && !GetDefault<UColorRampNodeSettings>()->bBakeOnCook)
 	{
-		return CustomCurveLinearColor->GetLinearColorValue(Time).ToFColor(true);
+		return;
 	}
 
-	return FColor(0, 0, 0, 255);
+	// After a load every node of the material is stale, bake them together.
+	TArray<UMaterialExpressionColorRamp*> StaleRamps;
+	GetRamps(GetAssetOwner(), StaleRamps);
+	StaleRamps.RemoveAll([](const UMaterialExpressionColorRamp* Ramp) { return Ramp->IsRampUpToDate(); });
+	StaleRamps.AddUnique(this);
+
+	RefreshRamps(StaleRamps);
 }
 
-void UMaterialExpressionColorRamp::GenerateRampTex(bool bInit)
+void UMaterialExpressionColorRamp::RefreshParametersAsync()
 {
-	// todo: move to constructor
-	UPackage* Package;
-	FString PackageName = PackagePath + TempTextureName;
-	Package = LoadPackage(nullptr, *PackageName, RF_Public | RF_Standalone | RF_MarkAsRootSet);
-	if (!Package)
+	SyncColorStamp();
+
+	const FSHAHash Key = ComputeRampKey();
+	const bool bNeedsBake = UsesRampTexture() && !bUseCustomCurveLinearColor && IsValid(TempCurvePtr)
+		&& Key != RampTexKey && !FColorRampTextureCache::Get().Contains(Key);
+
+	// Dragging a stop between close neighbours touches a few texels, cheaper to patch right away than to hand off.
+	int32 Begin, End;
+	const bool bSmallEdit = bNeedsBake && GetPartialBakeSpan(Begin, End) && End - Begin <= SyncPartialBakeTexels;
+	if (!bNeedsBake || bSmallEdit || !CVarColorRampAsyncBake.GetValueOnGameThread())
 	{
-		Package = CreatePackage(*PackageName);
+		RefreshParameters(nullptr, false);
+		return;
 	}
-	// check(Package)
-	Package->FullyLoad();
 
-	UTexture2D* NewTexture = NewObject<UTexture2D>(Package, *TempTextureName, RF_Public | RF_Standalone | RF_MarkAsRootSet);
-	NewTexture->AddToRoot();
-	
-	FTexturePlatformData* Data = new FTexturePlatformData();
-	Data->SizeX = Resolution;
-	Data->SizeY = 1;
-	Data->SetNumSlices(1);
-	Data->PixelFormat = EPixelFormat::PF_B8G8R8A8;
-	
-	NewTexture->SetPlatformData(Data);
+	const uint32 Serial = ++(*LatestBakeSerial);
+	TSharedRef<std::atomic<uint32>, ESPMode::ThreadSafe> LatestSerial = LatestBakeSerial;
+	TWeakObjectPtr<UMaterialExpressionColorRamp> WeakThis(this);
+	const int32 Width = GetRampWidth();
+	const FColorRampTexelMapping Mapping = GetTexelMapping(Width);
+	const EColorRampFormat TexFormat = GetRampFormat();
 
-	uint8* Pixels = new uint8[Resolution * 1 * 4];
-	if (!bInit)
+	// The evaluator holds a copy of the stops, the task never touches the node.
+	Async(EAsyncExecution::ThreadPool, [Evaluator = FColorRampEvaluator(ColorStamp.ColorPosArray, RampType, !bSRGB), Width, Mapping, TexFormat, Key, Serial, LatestSerial, WeakThis]()
 	{
-		for (int32 x = 0; x < Resolution; x++)
+		if (LatestSerial->load() != Serial)
 		{
-			FColor Col = GetCurrentColor(x);
-			Pixels[4 * x] = Col.B;
-			Pixels[4 * x + 1] = Col.G;
-			Pixels[4 * x + 2] = Col.R;
-			
-			Pixels[4 * x + 3] = 255;
+			return;
 		}
+
+		TArray<uint8> Pixels;
+		Pixels.SetNumUninitialized(Width * GetRampFormatInfo(TexFormat).BytesPerTexel);
+		BakeEvaluatorTexels(Evaluator, Width, Mapping, TexFormat, Pixels.GetData(), 0, Width);
+
+		AsyncTask(ENamedThreads::GameThread, [Pixels = MoveTemp(Pixels), Key, Serial, LatestSerial, WeakThis]()
+		{
+			UMaterialExpressionColorRamp* Ramp = WeakThis.Get();
+			if (Ramp && LatestSerial->load() == Serial)
+			{
+				Ramp->CommitAsyncBake(Key, Pixels);
+			}
+		});
+	});
+}
+
+void UMaterialExpressionColorRamp::CommitAsyncBake(const FSHAHash& Key, const TArray<uint8>& Pixels)
+{
+	const uint32 CompiledState = GetCompiledStateHash();
+
+	// Settings changed since the request without going through a refresh, the texels are stale.
+	SyncColorStamp();
+	RefreshParameters(ComputeRampKey() == Key ? &Pixels : nullptr, false);
+	if (GetCompiledStateHash() != CompiledState)
+	{
+		RequestRecompile();
 	}
-	else
+}
+
+uint32 UMaterialExpressionColorRamp::GetCompiledStateHash() const
+{
+	if (UseALU())
 	{
-		for (int32 x = 0; x < Resolution; x++)
-		{
-			Pixels[4 * x] = 0;
-			Pixels[4 * x + 1] = 0;
-			Pixels[4 * x + 2] = 0;
-			Pixels[4 * x + 3] = 255;
-		}
+		return GetTypeHash(ComputeRampKey());
 	}
 
-	FTexture2DMipMap* Mip = new FTexture2DMipMap();
-	NewTexture->GetPlatformData()->Mips.Add(Mip);
-	Mip->SizeX = Resolution;
-	Mip->SizeY = 1;
+	// Texels rewritten in place keep the texture, a new texture has to be bound by the shader map.
+	uint32 Hash = GetTypeHash(TempRampTexPtr.Get());
+	if (UseAtlas())
+	{
+		Hash = HashCombine(Hash, HashCombine(GetTypeHash(AtlasRow), GetTypeHash(AtlasNumRows)));
+	}
+	return Hash;
+}
 
-	Mip->BulkData.Lock(LOCK_READ_WRITE);
-	uint8* TextureData = (uint8*)Mip->BulkData.Realloc(Resolution * 4);
-	FMemory::Memcpy(TextureData, Pixels, sizeof(uint8) * Resolution * 4);
-	Mip->BulkData.Unlock();
+void UMaterialExpressionColorRamp::RecompileOwner()
+{
+	if (UObject* Owner = GetAssetOwner())
+	{
+		Owner->PreEditChange(nullptr);
+		Owner->PostEditChange();
+	}
+}
 
-	NewTexture->Source.Init(Resolution, 1, 1, 1, ETextureSourceFormat::TSF_BGRA8, Pixels);
-	NewTexture->SRGB = 0;
-	NewTexture->UpdateResource();
-	Package->MarkPackageDirty();
-	FAssetRegistryModule::AssetCreated(NewTexture);
-	// FString PackageFileName = FPackageName::LongPackageNameToFilename(PackageName, FPackageName::GetAssetPackageExtension());
-	// bool bSaved = UPackage::SavePackage(Package, NewTexture, EObjectFlags::RF_Public | EObjectFlags::RF_Standalone, *PackageFileName, GError, nullptr, true, true, SAVE_NoError);
+void UMaterialExpressionColorRamp::RequestRecompile()
+{
+	UTransBuffer* TransBuffer = GEditor ? Cast<UTransBuffer>(GEditor->Trans) : nullptr;
+	if (!TransBuffer || !GEditor->IsTransactionActive())
+	{
+		ClearPendingRecompile();
+		RecompileOwner();
+		return;
+	}
 
-	TempRampTexPtr = NewTexture;
+	if (!TransactionStateHandle.IsValid())
+	{
+		TransactionStateHandle = TransBuffer->OnTransactionStateChanged().AddUObject(this, &UMaterialExpressionColorRamp::OnTransactionStateChanged);
+	}
+}
 
-	delete[] Pixels;
+void UMaterialExpressionColorRamp::OnTransactionStateChanged(const FTransactionContext& , ETransactionStateEventType TransactionState)
+{
+	if (TransactionState == ETransactionStateEventType::TransactionFinalized || TransactionState == ETransactionStateEventType::TransactionCanceled)
+	{
+		ClearPendingRecompile();
+		RecompileOwner();
+	}
 }
 
-void UMaterialExpressionColorRamp::GenerateRampCurve()
+void UMaterialExpressionColorRamp::ClearPendingRecompile()
 {
-	if (IsValid(TempCurvePtr))
+	if (!TransactionStateHandle.IsValid())
 	{
-		if (OnUpdateCurveHandle.IsValid())
-			TempCurvePtr->OnUpdateCurve.Remove(OnUpdateCurveHandle);
+		return;
 	}
-	
-	UPackage* Package;
-	FString PackageName = PackagePath + TempCurveName;
-	Package = LoadPackage(nullptr, *PackageName, RF_Public | RF_Standalone | RF_MarkAsRootSet);
-	if (!Package)
+
+	if (UTransBuffer* TransBuffer = GEditor ? Cast<UTransBuffer>(GEditor->Trans) : nullptr)
 	{
-		Package = CreatePackage(*PackageName);
+		TransBuffer->OnTransactionStateChanged().Remove(TransactionStateHandle);
 	}
-	// check(Package)
-	Package->FullyLoad();
+	TransactionStateHandle.Reset();
+}
 
-	UCurveLinearColor* NewCurve = NewObject<UCurveLinearColor>(Package, *TempCurveName, RF_Public | RF_Standalone | RF_MarkAsRootSet);
-	NewCurve->AddToRoot();
+FSHAHash UMaterialExpressionColorRamp::ComputeRampKey() const
+{
+	// Bump when the baked texels change for the same inputs.
+	static constexpr int32 RampKeyVersion = 7;
 
-	Package->MarkPackageDirty();
-	FAssetRegistryModule::AssetCreated(NewCurve);
+	TArray<uint8> KeyData;
+	FMemoryWriter Ar(KeyData);
 
-	TempCurvePtr = NewCurve;
-	bValidCurve = true;
+	int32 Version = RampKeyVersion;
+	uint8 Type = RampType;
+	int32 Width = Resolution;
+	bool bCustomCurve = bUseCustomCurveLinearColor;
+	uint8 TexFormat = GetRampFormat();
+	Ar << Version << Type << Width << bCustomCurve << TexFormat;
 
-	OnUpdateCurveHandle = TempCurvePtr->OnUpdateCurve.AddUObject(this, &UMaterialExpressionColorRamp::OnUpdateCurve);
-}
+	if (!bCustomCurve)
+	{
+		bool bSRGBKey = bSRGB;
+		Ar << bSRGBKey;
 
+		// The width is derived from the stops and the tolerance.
+		bool bAutoWidth = UseAutoResolution();
+		Ar << bAutoWidth;
+		if (bAutoWidth)
+		{
+			float Tolerance = GetDefault<UColorRampNodeSettings>()->AutoResolutionTolerance;
+			Ar << Tolerance;
+		}
 
-int32 UMaterialExpressionColorRamp::Luminance(int32 Input, FMaterialCompiler* Compiler)
+		for (FGradientColorPos ColorPos : ColorStamp.ColorPosArray)
+		{
+			Ar << ColorPos.Color << ColorPos.Position;
+		}
+	}
+	else if (IsValid(CustomCurveLinearColor))
+	{
+		// GetLinearColorValue applies the curve's color adjustments on top of the keys.
+		Ar << CustomCurveLinearColor->AdjustHue << CustomCurveLinearColor->AdjustSaturation
+			<< CustomCurveLinearColor->AdjustBrightness << CustomCurveLinearColor->AdjustBrightnessCurve
+			<< CustomCurveLinearColor->AdjustVibrance << CustomCurveLinearColor->AdjustMinAlpha
+			<< CustomCurveLinearColor->AdjustMaxAlpha;
+
+		for (FRichCurve& Curve : CustomCurveLinearColor->FloatCurves)
+		{
+			Ar << Curve.DefaultValue;
+			for (FRichCurveKey Key : Curve.Keys)
+			{
+				Ar << Key;
+			}
+		}
+	}
+
+	FSHAHash Key;
+	FSHA1::HashBuffer(KeyData.GetData(), KeyData.Num(), Key.Hash);
+	return Key;
+}
+
+bool UMaterialExpressionColorRamp::IsRampUpToDate() const
 {
-	int32 RW = Compiler->Constant(0.299f);
-	int32 GW = Compiler->Constant(0.578f);
-	int32 BW = Compiler->Constant(0.114f);
+	if (!IsValid(TempCurvePtr) || !OnUpdateCurveHandle.IsValid())
+	{
+		return false;
+	}
 
-	int32 R = Compiler->ComponentMask(Input, true, false, false, false);
-	int32 G = Compiler->ComponentMask(Input, false, true, false, false);
-	int32 B = Compiler->ComponentMask(Input, false, false, true, false);
+	if (UseALU())
+	{
+		return true;
+	}
 
-	return Compiler->Add(
-			Compiler->Add(
-				Compiler->Mul(R, RW),
-				Compiler->Mul(G, GW)),
-				Compiler->Mul(B, BW));
+	if (!IsValid(TempRampTexPtr))
+	{
+		return false;
+	}
+
+	if (UseAtlas())
+	{
+		FAtlasLayout Layout;
+		GetAtlasLayout(Layout);
+		return RampTexKey == Layout.Key;
+	}
+
+	return RampTexKey == ComputeRampKey();
 }
 
-int32 UMaterialExpressionColorRamp::LinearRamp(int32 Input, FMaterialCompiler* Compiler)
+void UMaterialExpressionColorRamp::GetRamps(UObject* AssetOwner, TArray<UMaterialExpressionColorRamp*>& OutRamps)
 {
-	if (!TempRampTexPtr)
+	TConstArrayView<TObjectPtr<UMaterialExpression>> Expressions;
+	if (UMaterial* OwnerMaterial = Cast<UMaterial>(AssetOwner))
 	{
-		return INDEX_NONE;
+		Expressions = OwnerMaterial->GetExpressions();
 	}
-	
-	int32 Value = Luminance(Input, Compiler);
-	int32 Coord = Compiler->AppendVector(Value, Compiler->Constant(0));
-	int32 Tex = Compiler->Texture(TempRampTexPtr, EMaterialSamplerType::SAMPLERTYPE_Color);
+	else if (UMaterialFunction* OwnerFunction = Cast<UMaterialFunction>(AssetOwner))
+	{
+		Expressions = OwnerFunction->GetExpressions();
+	}
+
+	for (UMaterialExpression* Expression : Expressions)
+	{
+		UMaterialExpressionColorRamp* Ramp = Cast<UMaterialExpressionColorRamp>(Expression);
+		if (IsValid(Ramp))
+		{
+			OutRamps.Add(Ramp);
+		}
+	}
+}
+
+int32 UMaterialExpressionColorRamp::RefreshRamps(TConstArrayView<UMaterialExpressionColorRamp*> Ramps)
+{
+	check(IsInGameThread());
 
-	return Compiler->TextureSample(Tex, Coord, EMaterialSamplerType::SAMPLERTYPE_LinearColor);
+	// Nodes with identical ramps share a texture, each distinct stale ramp is baked once.
+	TMap<FSHAHash, const UMaterialExpressionColorRamp*> PendingRamps;
+	for (UMaterialExpressionColorRamp* Ramp : Ramps)
+	{
+		Ramp->SyncColorStamp();
+		if (Ramp->UsesRampTexture())
+		{
+			const FSHAHash Key = Ramp->ComputeRampKey();
+			if ((Key != Ramp->RampTexKey || !IsValid(Ramp->TempRampTexPtr)) && !FColorRampTextureCache::Get().Contains(Key))
+			{
+				PendingRamps.FindOrAdd(Key, Ramp);
+			}
+		}
+	}
+
+	TArray<FSHAHash> Keys;
+	PendingRamps.GetKeys(Keys);
+
+	// Texel generation only reads the ramps, the UObject work below stays on the game thread.
+	TArray<TArray<uint8>> Texels;
+	Texels.SetNum(Keys.Num());
+	ParallelFor(Keys.Num(), [&Keys, &Texels, &PendingRamps](int32 Index)
+	{
+		const UMaterialExpressionColorRamp* Ramp = PendingRamps[Keys[Index]];
+		const EColorRampFormat TexFormat = Ramp->GetRampFormat();
+		const int32 Width = Ramp->GetRampWidth();
+		GetCachedRampPixels(Keys[Index], Width * GetRampFormatInfo(TexFormat).BytesPerTexel, Texels[Index], true,
+			[Ramp, Width, TexFormat](uint8* Pixels) { Ramp->BakeRampPixels(Pixels, Width, TexFormat); });
+	});
+
+	for (UMaterialExpressionColorRamp* Ramp : Ramps)
+	{
+		const int32 KeyIndex = Ramp->UsesRampTexture() ? Keys.IndexOfByKey(Ramp->ComputeRampKey()) : INDEX_NONE;
+		Ramp->RefreshParameters(KeyIndex != INDEX_NONE ? &Texels[KeyIndex] : nullptr);
+	}
+
+	return Keys.Num();
+}
+
+void UMaterialExpressionColorRamp::GetAtlasLayout(FAtlasLayout& OutLayout) const
+{
+	TArray<UMaterialExpressionColorRamp*> AtlasRamps;
+	GetRamps(GetAssetOwner(), AtlasRamps);
+	AtlasRamps.RemoveAll([](const UMaterialExpressionColorRamp* Ramp) { return !Ramp->UseAtlas(); });
+
+	// Not in the expression list yet while the node is being placed.
+	AtlasRamps.AddUnique(const_cast<UMaterialExpressionColorRamp*>(this));
+
+	// Rows follow the order of the nodes in the material, so editing a ramp only changes its own row.
+	// Identical ramps share the row of the first one.
+	OutLayout.Width = 1;
+	for (UMaterialExpressionColorRamp* Ramp : AtlasRamps)
+	{
+		const FSHAHash RowKey = Ramp->ComputeRampKey();
+		OutLayout.Width = FMath::Max(OutLayout.Width, Ramp->Resolution);
+		if (!OutLayout.RowKeys.Contains(RowKey))
+		{
+			OutLayout.RowKeys.Add(RowKey);
+			OutLayout.RowRamps.Add(Ramp);
+		}
+	}
+
+	FSHA1 HashState;
+	HashState.UpdateWithString(TEXT("ColorRampAtlas"), 14);
+	HashState.Update((const uint8*)&OutLayout.Width, sizeof(OutLayout.Width));
+	for (const FSHAHash& RowKey : OutLayout.RowKeys)
+	{
+		HashState.Update(RowKey.Hash, sizeof(RowKey.Hash));
+	}
+	HashState.Final();
+	HashState.GetHash(OutLayout.Key.Hash);
+}
+
+void UMaterialExpressionColorRamp::RefreshAtlas(bool bUseDDC)
+{
+	FAtlasLayout Layout;
+	GetAtlasLayout(Layout);
+
+	AtlasRow = FMath::Max(Layout.RowKeys.IndexOfByKey(ComputeRampKey()), 0);
+	AtlasNumRows = Layout.RowKeys.Num();
+
+	if (Layout.Key == RampTexKey && IsValid(TempRampTexPtr))
+	{
+		return;
+	}
+
+	if (UpdateAtlasInPlace(Layout))
+	{
+		return;
+	}
+
+	TempTextureName = "ColorRampTempTex_Atlas_" + Layout.Key.ToString();
+
+	TempRampTexPtr = FColorRampTextureCache::Get().Acquire(Layout.Key, [this, &Layout, bUseDDC]() { return GenerateAtlasTex(Layout, bUseDDC); });
+	ReleaseRampTexture();
+	RampTexKey = Layout.Key;
+	HeldAtlasRowKeys = Layout.RowKeys;
+	HeldAtlasWidth = Layout.Width;
+}
+
+UTexture2D* UMaterialExpressionColorRamp::GenerateAtlasTex(const FAtlasLayout& Layout, bool bUseDDC)
+{
+	const int32 RowBytes = Layout.Width * GetRampFormatInfo(CRF_BGRA8).BytesPerTexel;
+
+	TArray<uint8> Pixels;
+	GetCachedRampPixels(Layout.Key, RowBytes * Layout.RowRamps.Num(), Pixels, bUseDDC, [&Layout, RowBytes](uint8* AtlasPixels)
+	{
+		ParallelFor(Layout.RowRamps.Num(), [&Layout, AtlasPixels, RowBytes](int32 Row)
+		{
+			Layout.RowRamps[Row]->BakeRampPixels(AtlasPixels + Row * RowBytes, Layout.Width, CRF_BGRA8);
+		});
+	});
+
+	return CreateRampTexture(Layout.Key, CRF_BGRA8, Layout.Width, Layout.RowRamps.Num(), Pixels.GetData());
+}
+
+void UMaterialExpressionColorRamp::ReleaseRampTexture()
+{
+	if (RampTexKey != FSHAHash())
+	{
+		FColorRampTextureCache::Get().Release(RampTexKey);
+		RampTexKey = FSHAHash();
+	}
+}
+
+UTexture2D* UMaterialExpressionColorRamp::GenerateRampTex(const FSHAHash& Key, const TArray<uint8>* BakedPixels, bool bUseDDC)
+{
+	const EColorRampFormat TexFormat = GetRampFormat();
+	const int32 Width = GetRampWidth();
+	const int32 NumBytes = Width * GetRampFormatInfo(TexFormat).BytesPerTexel;
+
+	if (BakedPixels)
+	{
+		check(BakedPixels->Num() == NumBytes);
+		return CreateRampTexture(Key, TexFormat, Width, 1, BakedPixels->GetData());
+	}
+
+	TArray<uint8> Pixels;
+	GetCachedRampPixels(Key, NumBytes, Pixels, bUseDDC, [this, Width, TexFormat](uint8* RampPixels) { BakeRampPixels(RampPixels, Width, TexFormat); });
+
+	return CreateRampTexture(Key, TexFormat, Width, 1, Pixels.GetData());
+}
+
+// Source id derived from the ramp key, the same texels always get the same id.
+static FGuid GetRampSourceId(const FSHAHash& Key)
+{
+	uint32 Words[4];
+	FMemory::Memcpy(Words, Key.Hash, sizeof(Words));
+	return FGuid(Words[0], Words[1], Words[2], Words[3]);
+}
+
+// True if ramp textures and curves are transient objects instead of /Game/ assets.
+// The cooker needs textures it can save, see CreateRampTexture.
+static bool UseTransientStorage()
+{
+	return GetDefault<UColorRampNodeSettings>()->RampStorage == CRS_TRANSIENT && !IsRunningCookCommandlet();
+}
+
+// One mip, always resident and uncompressed, so gradients do not band. Clamped so the ends do not wrap.
+static void ApplyRampTextureSettings(UTexture2D* Texture, const FRampFormatInfo& FormatInfo, bool bNearestFilter)
+{
+	Texture->Filter = bNearestFilter ? TF_Nearest : TF_Default;
+	Texture->SRGB = 0;
+	Texture->LODGroup = TEXTUREGROUP_ColorLookupTable;
+	Texture->MipGenSettings = TMGS_NoMipmaps;
+	Texture->CompressionSettings = FormatInfo.Compression;
+	Texture->NeverStream = true;
+	Texture->AddressX = TA_Clamp;
+	Texture->AddressY = TA_Clamp;
+}
+
+// True if the platform data of Texture is the single uncompressed mip filled by CreateRampTexture.
+static bool HasRampPlatformData(UTexture2D* Texture, const FRampFormatInfo& FormatInfo, int32 SizeX, int32 SizeY)
+{
+	const FTexturePlatformData* Data = Texture->GetPlatformData();
+	return Data && Data->Mips.Num() == 1 && Data->SizeX == SizeX && Data->SizeY == SizeY && Data->PixelFormat == FormatInfo.PixelFormat;
+}
+
+// Copies pixels of Format into the source and platform data of a ramp texture, fails if its size or format differ.
+static bool WriteRampTexels(UTexture2D* Texture, const FSHAHash& Key, EColorRampFormat Format, bool bNearestFilter, int32 SizeX, int32 SizeY, const uint8* Pixels)
+{
+	const FRampFormatInfo& FormatInfo = GetRampFormatInfo(Format);
+	if (!Texture || Texture->Source.GetSizeX() != SizeX || Texture->Source.GetSizeY() != SizeY || Texture->Source.GetFormat() != FormatInfo.SourceFormat)
+	{
+		return false;
+	}
+
+	const int32 NumBytes = SizeX * SizeY * FormatInfo.BytesPerTexel;
+
+	FMemory::Memcpy(Texture->Source.LockMip(0), Pixels, NumBytes);
+	Texture->Source.UnlockMip(0);
+
+	// The id follows the texels, derived data of an older bake is never served for them.
+	Texture->Source.SetId(GetRampSourceId(Key), true);
+	ApplyRampTextureSettings(Texture, FormatInfo, bNearestFilter);
+
+	if (HasRampPlatformData(Texture, FormatInfo, SizeX, SizeY))
+	{
+		// Platform data filled by CreateRampTexture, written directly.
+		FTexture2DMipMap& Mip = Texture->GetPlatformData()->Mips[0];
+		FMemory::Memcpy(Mip.BulkData.Lock(LOCK_READ_WRITE), Pixels, NumBytes);
+		Mip.BulkData.Unlock();
+		Texture->UpdateResource();
+	}
+	else
+	{
+		// Loaded from disk, the platform data is built from the new source.
+		Texture->PostEditChange();
+	}
+
+	Texture->MarkPackageDirty();
+
+	return true;
+}
+
+// True if texels of a Width by Height ramp texture of Format can be written by WriteRampTexelSpan.
+static bool CanWriteRampTexelSpan(UTexture2D* Texture, EColorRampFormat Format, int32 Width, int32 Height = 1)
+{
+	const FRampFormatInfo& FormatInfo = GetRampFormatInfo(Format);
+	return Texture && Texture->Source.GetSizeX() == Width && Texture->Source.GetSizeY() == Height && Texture->Source.GetFormat() == FormatInfo.SourceFormat
+		&& HasRampPlatformData(Texture, FormatInfo, Width, Height);
+}
+
+// Copies texels [Begin, End) of RowPixels into row Row of the source and platform data of a ramp texture
+// Width texels wide, then uploads only that span instead of recreating the whole resource.
+static void WriteRampTexelSpan(UTexture2D* Texture, const FSHAHash& Key, EColorRampFormat Format, int32 Width, int32 Row, int32 Begin, int32 End, const uint8* RowPixels)
+{
+	const FRampFormatInfo& FormatInfo = GetRampFormatInfo(Format);
+	const int32 SpanOffset = Begin * FormatInfo.BytesPerTexel;
+	const int32 Offset = Row * Width * FormatInfo.BytesPerTexel + SpanOffset;
+	const int32 NumBytes = (End - Begin) * FormatInfo.BytesPerTexel;
+
+	FMemory::Memcpy(Texture->Source.LockMip(0) + Offset, RowPixels + SpanOffset, NumBytes);
+	Texture->Source.UnlockMip(0);
+	Texture->Source.SetId(GetRampSourceId(Key), true);
+
+	// Kept in sync for when the resource is recreated.
+	FTexture2DMipMap& Mip = Texture->GetPlatformData()->Mips[0];
+	FMemory::Memcpy(static_cast<uint8*>(Mip.BulkData.Lock(LOCK_READ_WRITE)) + Offset, RowPixels + SpanOffset, NumBytes);
+	Mip.BulkData.Unlock();
+
+	FColorRampTexels::UploadTexelSpan(Texture, Row, Begin, End, FormatInfo.BytesPerTexel, RowPixels + SpanOffset);
+
+	Texture->MarkPackageDirty();
+}
+
+bool UMaterialExpressionColorRamp::UpdateAtlasInPlace(const FAtlasLayout& Layout)
+{
+	FColorRampTextureCache& Cache = FColorRampTextureCache::Get();
+	if (RampTexKey == FSHAHash() || !IsValid(TempRampTexPtr) || Cache.Contains(Layout.Key)
+		|| HeldAtlasWidth != Layout.Width || HeldAtlasRowKeys.Num() != Layout.RowKeys.Num())
+	{
+		return false;
+	}
+
+	// Every atlas node of the material holds the atlas. A material with the same layout shares it, it must not change under that one.
+	TArray<UMaterialExpressionColorRamp*> Holders;
+	GetRamps(GetAssetOwner(), Holders);
+	Holders.RemoveAll([this](const UMaterialExpressionColorRamp* Ramp) { return Ramp->RampTexKey != RampTexKey; });
+	if (Cache.GetRefCount(RampTexKey) != Holders.Num())
+	{
+		return false;
+	}
+
+	// A loaded atlas may be drawn by other materials that never acquired it, only one a holder created is rewritten.
+	if (!Holders.ContainsByPredicate([this](const UMaterialExpressionColorRamp* Ramp) { return Ramp->CreatedRampTex.Get() == TempRampTexPtr; }))
+	{
+		return false;
+	}
+
+	const FString NewTextureName = "ColorRampTempTex_Atlas_" + Layout.Key.ToString();
+	if (!CanRenameRampTexture(NewTextureName) || !CanWriteRampTexelSpan(TempRampTexPtr, CRF_BGRA8, Layout.Width, Layout.RowKeys.Num()))
+	{
+		return false;
+	}
+
+	// Only the rows of edited ramps are baked and uploaded.
+	TArray<uint8> RowPixels;
+	RowPixels.SetNumUninitialized(Layout.Width * GetRampFormatInfo(CRF_BGRA8).BytesPerTexel);
+	for (int32 Row = 0; Row < Layout.RowKeys.Num(); Row++)
+	{
+		if (Layout.RowKeys[Row] != HeldAtlasRowKeys[Row])
+		{
+			Layout.RowRamps[Row]->BakeRampPixels(RowPixels.GetData(), Layout.Width, CRF_BGRA8);
+			WriteRampTexelSpan(TempRampTexPtr, Layout.Key, CRF_BGRA8, Layout.Width, Row, 0, Layout.Width, RowPixels.GetData());
+		}
+	}
+
+	RenameRampTexture(TempRampTexPtr, NewTextureName);
+	Cache.Rekey(RampTexKey, Layout.Key);
+	for (UMaterialExpressionColorRamp* Holder : Holders)
+	{
+		Holder->RampTexKey = Layout.Key;
+		Holder->HeldAtlasRowKeys = Layout.RowKeys;
+	}
+
+	return true;
+}
+
+bool UMaterialExpressionColorRamp::CanRenameRampTexture(const FString& NewName) const
+{
+	// A package of that name in memory belongs to another texture, it is picked up by CreateRampTexture instead.
+	// While cooking a loaded texture belongs to a source package, it is never rewritten.
+	return !IsRunningCookCommandlet() && (UseTransientStorage() || !FindPackage(nullptr, *(PackagePath + NewName)));
+}
+
+void UMaterialExpressionColorRamp::RenameRampTexture(UTexture2D* Texture, const FString& NewName)
+{
+	TempTextureName = NewName;
+
+	// Transient textures are never looked up by name.
+	UPackage* Package = Texture->GetPackage();
+	if (Package == GetTransientPackage())
+	{
+		return;
+	}
+
+	// The file of a texture loaded from disk is left alone, it still holds the texels of the old key.
+	if (Package->GetLinker())
+	{
+		ResetLoaders(Package);
+	}
+
+	const ERenameFlags Flags = REN_DontCreateRedirectors | REN_NonTransactional | REN_ForceNoResetLoaders;
+	Package->Rename(*(PackagePath + NewName), nullptr, Flags);
+	Texture->Rename(*NewName, nullptr, Flags);
+	Package->MarkPackageDirty();
+}
+
+UTexture2D* UMaterialExpressionColorRamp::CreateRampTexture(const FSHAHash& Key, EColorRampFormat InFormat, int32 SizeX, int32 SizeY, const uint8* Pixels)
+{
+	const FRampFormatInfo& FormatInfo = GetRampFormatInfo(InFormat);
+
+	UPackage* Package = nullptr;
+	FName TextureName = *TempTextureName;
+	EObjectFlags Flags = RF_Public | RF_Standalone;
+
+	if (IsRunningCookCommandlet())
+	{
+		// Cook-only object in the package of the material being cooked, saved with the cooked material
+		// and never with the source package. No asset registry entry.
+		Package = GetAssetOwner()->GetPackage();
+		TextureName = MakeUniqueObjectName(Package, UTexture2D::StaticClass(), TextureName);
+		Flags = RF_Public;
+	}
+	else if (UseTransientStorage())
+	{
+		// No package I/O and no asset registry entry. Never saved, baked again after a load.
+		Package = GetTransientPackage();
+		TextureName = MakeUniqueObjectName(Package, UTexture2D::StaticClass(), TextureName);
+		Flags = RF_Transient;
+	}
+	else
+	{
+		// todo: move to constructor
+		FString PackageName = PackagePath + TempTextureName;
+		Package = LoadPackage(nullptr, *PackageName, RF_Public | RF_Standalone | RF_MarkAsRootSet);
+		if (!Package)
+		{
+			// Cleared once saved, tells the texture cache the package is not on disk yet.
+			Package = CreatePackage(*PackageName);
+			Package->SetPackageFlags(PKG_NewlyCreated);
+		}
+		// check(Package)
+		Package->FullyLoad();
+
+		// Textures rewritten in place move to the name of their new key, a texture found under
+		// a key name holds the texels of that key. Other saved materials may reference it, it is
+		// only reused as is, never rewritten.
+		if (UTexture2D* ExistingTexture = FindObjectFast<UTexture2D>(Package, TextureName))
+		{
+			if (!FColorRampTextureCache::Get().HoldsTexture(ExistingTexture) && ExistingTexture->Source.GetId() == GetRampSourceId(Key))
+			{
+				ExistingTexture->SetFlags(RF_Public | RF_Standalone);
+				return ExistingTexture;
+			}
+
+			TextureName = MakeUniqueObjectName(Package, UTexture2D::StaticClass(), TextureName);
+		}
+	}
+
+	// Kept alive by FColorRampTextureCache while any node uses it.
+	UTexture2D* NewTexture = NewObject<UTexture2D>(Package, TextureName, Flags);
+	CreatedRampTex = NewTexture;
+	
+	FTexturePlatformData* Data = new FTexturePlatformData();
+	Data->SizeX = SizeX;
+	Data->SizeY = SizeY;
+	Data->SetNumSlices(1);
+	Data->PixelFormat = FormatInfo.PixelFormat;
+	
+	NewTexture->SetPlatformData(Data);
+
+	FTexture2DMipMap* Mip = new FTexture2DMipMap();
+	NewTexture->GetPlatformData()->Mips.Add(Mip);
+	Mip->SizeX = SizeX;
+	Mip->SizeY = SizeY;
+
+	Mip->BulkData.Lock(LOCK_READ_WRITE);
+	uint8* TextureData = (uint8*)Mip->BulkData.Realloc(SizeX * SizeY * FormatInfo.BytesPerTexel);
+	FMemory::Memcpy(TextureData, Pixels, sizeof(uint8) * SizeX * SizeY * FormatInfo.BytesPerTexel);
+	Mip->BulkData.Unlock();
+
+	NewTexture->Source.Init(SizeX, SizeY, 1, 1, FormatInfo.SourceFormat, Pixels);
+	NewTexture->Source.SetId(GetRampSourceId(Key), true);
+	ApplyRampTextureSettings(NewTexture, FormatInfo, UseNearestFilter());
+	NewTexture->UpdateResource();
+	if (!NewTexture->HasAnyFlags(RF_Transient) && !IsRunningCookCommandlet())
+	{
+		Package->MarkPackageDirty();
+		FAssetRegistryModule::AssetCreated(NewTexture);
+	}
+	// FString PackageFileName = FPackageName::LongPackageNameToFilename(PackageName, FPackageName::GetAssetPackageExtension());
+	// bool bSaved = UPackage::SavePackage(Package, NewTexture, EObjectFlags::RF_Public | EObjectFlags::RF_Standalone, *PackageFileName, GError, nullptr, true, true, SAVE_NoError);
+
+	return NewTexture;
+}
+
+bool UMaterialExpressionColorRamp::UpdateRampTexInPlace(UTexture2D* Texture, const FSHAHash& Key, const TArray<uint8>* BakedPixels)
+{
+	const EColorRampFormat TexFormat = GetRampFormat();
+	const int32 Width = GetRampWidth();
+
+	if (BakedPixels)
+	{
+		return WriteRampTexels(Texture, Key, TexFormat, UseNearestFilter(), Width, 1, BakedPixels->GetData());
+	}
+
+	TArray<uint8> Pixels;
+	Pixels.SetNumUninitialized(Width * GetRampFormatInfo(TexFormat).BytesPerTexel);
+	BakeRampPixels(Pixels.GetData(), Width, TexFormat);
+
+	return WriteRampTexels(Texture, Key, TexFormat, UseNearestFilter(), Width, 1, Pixels.GetData());
+}
+
+bool UMaterialExpressionColorRamp::UpdateRampTexSpan(UTexture2D* Texture, const FSHAHash& Key, int32 Begin, int32 End, const TArray<uint8>* BakedPixels)
+{
+	const EColorRampFormat TexFormat = GetRampFormat();
+	const int32 Width = GetRampWidth();
+	if (!CanWriteRampTexelSpan(Texture, TexFormat, Width))
+	{
+		return false;
+	}
+
+	if (BakedPixels)
+	{
+		WriteRampTexelSpan(Texture, Key, TexFormat, Width, 0, Begin, End, BakedPixels->GetData());
+		return true;
+	}
+
+	// Only the span is baked, the rest of the row is never read.
+	TArray<uint8> Pixels;
+	Pixels.SetNumUninitialized(Width * GetRampFormatInfo(TexFormat).BytesPerTexel);
+	FColorRampEvaluator Evaluator(ColorStamp.ColorPosArray, RampType, !bSRGB);
+	BakeEvaluatorTexels(Evaluator, Width, GetTexelMapping(Width), TexFormat, Pixels.GetData(), Begin, End);
+
+	WriteRampTexelSpan(Texture, Key, TexFormat, Width, 0, Begin, End, Pixels.GetData());
+	return true;
+}
+
+// Largest channel difference between the ramp and its bilinear filtered texture of Width texels holding the ends mapping.
+static float GetFilteredRampError(const FColorRampEvaluator& Evaluator, TConstArrayView<FGradientColorPos> Stops, int32 Width)
+{
+	const FColorRampTexelMapping Mapping = FColorRampTexelMapping::Ends(Width);
+
+	auto GetError = [&Evaluator, &Mapping, Width](float Time)
+	{
+		const float X = FMath::Clamp(Time, 0.f, 1.f) * float(Width - 1);
+		const int32 Index = FMath::Min(FMath::FloorToInt(X), Width - 2);
+		const FLinearColor Filtered = FMath::Lerp(Evaluator.EvaluateLinear(Mapping.GetTime(Index)), Evaluator.EvaluateLinear(Mapping.GetTime(Index + 1)), X - float(Index));
+		const FLinearColor Difference = Filtered - Evaluator.EvaluateLinear(Time);
+		return FMath::Max(FMath::Max(FMath::Abs(Difference.R), FMath::Abs(Difference.G)), FMath::Max(FMath::Abs(Difference.B), FMath::Abs(Difference.A)));
+	};
+
+	// The filtered ramp is exact on texels. Between them the error peaks at the stops, or anywhere
+	// in a segment once sRGB encoding bends it, which the texel midpoints cover.
+	float MaxError = 0.f;
+	for (const FGradientColorPos& Stop : Stops)
+	{
+		MaxError = FMath::Max(MaxError, GetError(Stop.Position));
+	}
+	for (int32 x = 0; x + 1 < Width; x++)
+	{
+		MaxError = FMath::Max(MaxError, GetError(Mapping.GetTime(x) + 0.5f * Mapping.Step));
+	}
+
+	return MaxError;
+}
+
+int32 UMaterialExpressionColorRamp::GetRampWidth() const
+{
+	if (!UseAutoResolution())
+	{
+		return Resolution;
+	}
+
+	const TArray<FGradientColorPos>& Stops = ColorStamp.ColorPosArray;
+
+	if (RampType == CRT_CONSTANT)
+	{
+		// Sampled without filtering, the steps are exact once every stop lies on a texel edge.
+		// Stops may be off by as much as a fixed Resolution texture would place them.
+		const float MaxOffset = 0.5f / float(Resolution);
+		for (int32 Width = 1; Width < Resolution; Width *= 2)
+		{
+			const bool bAligned = Algo::AllOf(Stops, [Width, MaxOffset](const FGradientColorPos& Stop)
+			{
+				return FMath::Abs(Stop.Position - FMath::RoundToFloat(Stop.Position * Width) / Width) <= MaxOffset;
+			});
+			if (bAligned)
+			{
+				return Width;
+			}
+		}
+		return Resolution;
+	}
+
+	const float Tolerance = GetDefault<UColorRampNodeSettings>()->AutoResolutionTolerance;
+	const FColorRampEvaluator Evaluator(Stops, RampType, !bSRGB);
+	for (int32 Width = 2; Width < Resolution; Width *= 2)
+	{
+		if (GetFilteredRampError(Evaluator, Stops, Width) <= Tolerance)
+		{
+			return Width;
+		}
+	}
+	return Resolution;
+}
+
+FColorRampTexelMapping UMaterialExpressionColorRamp::GetTexelMapping(int32 Width) const
+{
+	// Unfiltered texels hold the band at their center, a stop moves to the nearest texel edge.
+	if (UseNearestFilter())
+	{
+		return FColorRampTexelMapping::Centers(Width);
+	}
+
+	return UseAutoResolution() ? FColorRampTexelMapping::Ends(Width) : FColorRampTexelMapping::Start(Width);
+}
+
+EColorRampFormat UMaterialExpressionColorRamp::GetRampFormat() const
+{
+	// Atlas rows share one BGRA8 texture.
+	if (UseAtlas())
+	{
+		return CRF_BGRA8;
+	}
+
+	if (Format != CRF_AUTO)
+	{
+		return Format;
+	}
+
+	// Instances may bind any ramp texture, the sampler type has to fit a UColorRampAtlas too.
+	if (bIsParameter)
+	{
+		return CRF_BGRA8;
+	}
+
+	// Custom curves are baked as they are, without looking at their values.
+	if (bUseCustomCurveLinearColor)
+	{
+		return CRF_BGRA8;
+	}
+
+	bool bGrayscale = true;
+	for (const FGradientColorPos& ColorPos : ColorStamp.ColorPosArray)
+	{
+		const FLinearColor& Color = ColorPos.Color;
+		if (FMath::Min3(Color.R, Color.G, Color.B) < 0.f || FMath::Max3(Color.R, Color.G, Color.B) > 1.f)
+		{
+			// 8 bit formats would clamp the stop.
+			return CRF_RGBA16F;
+		}
+
+		bGrayscale &= Color.R == Color.G && Color.G == Color.B && Color.A >= 1.f;
+	}
+
+	return bGrayscale ? CRF_R8 : CRF_BGRA8;
+}
+
+void UMaterialExpressionColorRamp::BakeRampPixels(uint8* Pixels, int32 Width, EColorRampFormat InFormat) const
+{
+	if (!bUseCustomCurveLinearColor)
+	{
+		FColorRampEvaluator Evaluator(ColorStamp.ColorPosArray, RampType, !bSRGB);
+		BakeEvaluatorTexels(Evaluator, Width, GetTexelMapping(Width), InFormat, Pixels, 0, Width);
+		return;
+	}
+
+	FColorRampTexels::BakeCurve(CustomCurveLinearColor, Width, GetRampFormatInfo(InFormat).PixelFormat, Pixels);
+}
+
+void UMaterialExpressionColorRamp::GenerateRampCurve()
+{
+	ReleaseRampCurve();
+
+	UCurveLinearColor* NewCurve = nullptr;
+	if (UseTransientStorage() || IsRunningCookCommandlet())
+	{
+		// Outered to the node, lives and dies with it. Curves are only edited, the cook never needs a saved one.
+		NewCurve = NewObject<UCurveLinearColor>(this, MakeUniqueObjectName(this, UCurveLinearColor::StaticClass(), *TempCurveName), RF_Transient);
+	}
+	else
+	{
+		UPackage* Package;
+		FString PackageName = PackagePath + TempCurveName;
+		Package = LoadPackage(nullptr, *PackageName, RF_Public | RF_Standalone | RF_MarkAsRootSet);
+		if (!Package)
+		{
+			Package = CreatePackage(*PackageName);
+		}
+		// check(Package)
+		Package->FullyLoad();
+
+		// Kept alive by TempCurvePtr.
+		NewCurve = NewObject<UCurveLinearColor>(Package, *TempCurveName, RF_Public | RF_Standalone);
+
+		Package->MarkPackageDirty();
+		FAssetRegistryModule::AssetCreated(NewCurve);
+	}
+
+	TempCurvePtr = NewCurve;
+	bValidCurve = true;
+
+	OnUpdateCurveHandle = TempCurvePtr->OnUpdateCurve.AddUObject(this, &UMaterialExpressionColorRamp::OnUpdateCurve);
+}
+
+void UMaterialExpressionColorRamp::ReleaseRampCurve()
+{
+	if (IsValid(TempCurvePtr))
+	{
+		if (OnUpdateCurveHandle.IsValid())
+			TempCurvePtr->OnUpdateCurve.Remove(OnUpdateCurveHandle);
+
+		// Curves of older versions were rooted.
+		TempCurvePtr->RemoveFromRoot();
+		TempCurvePtr->ClearFlags(RF_Standalone);
+	}
+
+	OnUpdateCurveHandle.Reset();
+}
+
+int32 UMaterialExpressionColorRamp::Luminance(int32 Input, FMaterialCompiler* Compiler)
+{
+	int32 RW = Compiler->Constant(0.299f);
+	int32 GW = Compiler->Constant(0.578f);
+	int32 BW = Compiler->Constant(0.114f);
+
+	int32 R = Compiler->ComponentMask(Input, true, false, false, false);
+	int32 G = Compiler->ComponentMask(Input, false, true, false, false);
+	int32 B = Compiler->ComponentMask(Input, false, false, true, false);
+
+	return Compiler->Add(
+			Compiler->Add(
+				Compiler->Mul(R, RW),
+				Compiler->Mul(G, GW)),
+				Compiler->Mul(B, BW));
+}
+
+int32 UMaterialExpressionColorRamp::LinearRamp(int32 Input, FMaterialCompiler* Compiler)
+{
+	if (!TempRampTexPtr)
+	{
+		return INDEX_NONE;
+	}
+	
+	int32 Value = Luminance(Input, Compiler);
+	if (UseAutoResolution() && RampType == CRT_LINEAR)
+	{
+		// The first and last texel hold the ends of the ramp, move 0 and 1 to their centers.
+		const float Width = float(TempRampTexPtr->Source.GetSizeX());
+		Value = Compiler->Add(Compiler->Mul(Value, Compiler->Constant((Width - 1.f) / Width)), Compiler->Constant(0.5f / Width));
+	}
+	// Grayscale textures are sampled as (R, R, R, 1).
+	const EMaterialSamplerType SamplerType = GetRampFormatInfo(GetRampFormat()).SamplerType;
+	int32 TextureReferenceIndex = INDEX_NONE;
+	int32 Tex = bIsParameter ? Compiler->TextureParameter(ParameterName, TempRampTexPtr, TextureReferenceIndex, SamplerType)
+		: Compiler->Texture(TempRampTexPtr, SamplerType);
+
+	// Atlas ramps sample the center of their row.
+	int32 V = Compiler->Constant(UseAtlas() ? (AtlasRow + 0.5f) / AtlasNumRows : 0.f);
+	if (bIsParameter && Row.GetTracedInput().Expression)
+	{
+		// The bound texture decides the row count, so instances can switch between atlases of any height.
+		int32 Height = Compiler->ComponentMask(Compiler->TextureProperty(Tex, TMTM_TextureSize), false, true, false, false);
+		V = Compiler->Div(Compiler->Add(Compiler->Floor(Row.Compile(Compiler)), Compiler->Constant(0.5f)), Height);
+	}
+	int32 Coord = Compiler->AppendVector(Value, V);
+
+	return Compiler->TextureSample(Tex, Coord, SamplerType);
+}
+
+bool UMaterialExpressionColorRamp::UseALU() const
+{
+	// Parameters expose the ramp texture.
+	if (bUseCustomCurveLinearColor || bIsParameter)
+	{
+		return false;
+	}
+
+	if (EvalMode == CREM_AUTO)
+	{
+		return ColorStamp.ColorPosArray.Num() < GetDefault<UColorRampNodeSettings>()->AutoALUStopLimit;
+	}
+
+	return EvalMode == CREM_ALU;
+}
+
+int32 UMaterialExpressionColorRamp::ALURamp(int32 Input, FMaterialCompiler* Compiler)
+{
+	const TArray<FGradientColorPos>& Stops = ColorStamp.ColorPosArray;
+	int32 Value = Luminance(Input, Compiler);
+
+	// Each stop blends in over the previous result, values outside the stops clamp to the end colors.
+	// Stops are encoded like the ramp texture, the ALU ramp is opaque.
+	FLinearColor StopColor = FColorRampEvaluator::EncodeLinear(Stops[0].Color, !bSRGB);
+	int32 Result = Compiler->Constant4(StopColor.R, StopColor.G, StopColor.B, 1.f);
+
+	for (int32 i = 1; i < Stops.Num(); ++i)
+	{
+		const float Start = Stops[i - 1].Position;
+		const float Span = Stops[i].Position - Start;
+
+		int32 Alpha;
+		if (RampType == CRT_CONSTANT || Span <= 0.f)
+		{
+			// Hard step once the value passes the stop, matching the baked (Start, End] segments.
+			Alpha = Compiler->Ceil(Compiler->Saturate(Compiler->Sub(Value, Compiler->Constant(Stops[i].Position))));
+		}
+		else
+		{
+			Alpha = Compiler->Saturate(Compiler->Mul(Compiler->Sub(Value, Compiler->Constant(Start)), Compiler->Constant(1.f / Span)));
+		}
+
+		StopColor = FColorRampEvaluator::EncodeLinear(Stops[i].Color, !bSRGB);
+		Result = Compiler->Lerp(Result, Compiler->Constant4(StopColor.R, StopColor.G, StopColor.B, 1.f), Alpha);
+	}
+
+	return Result;
 }
 
 #undef LOCTEXT_NAMESPACE
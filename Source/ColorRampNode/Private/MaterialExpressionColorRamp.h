@@ -2,35 +2,31 @@
 
 #include "CoreMinimal.h"
 #include "Materials/MaterialExpression.h"
+#include "Misc/ITransaction.h"
+#include "Misc/SecureHash.h"
+#include "ColorRampTypes.h"
+#include <atomic>
 
 #include "MaterialExpressionColorRamp.generated.h"
 
+struct FColorRampTexelMapping;
+
 UENUM()
-enum EColorRampType
+enum EColorRampEvalMode
 {
-	CRT_LINEAR		UMETA(DisplayName = "Linear"),
-	CRT_CONSTANT	UMETA(DisplayName = "Constant")
+	CREM_TEXTURE	UMETA(DisplayName = "Texture", ToolTip = "Sample a baked ramp texture."),
+	CREM_ALU		UMETA(DisplayName = "ALU", ToolTip = "Evaluate the stops in the shader, no texture sample."),
+	CREM_AUTO		UMETA(DisplayName = "Auto", ToolTip = "ALU for ramps with few stops, texture otherwise."),
+	CREM_ATLAS		UMETA(DisplayName = "Atlas", ToolTip = "Sample one row of a texture shared by all Atlas ramps of the material.")
 };
 
-USTRUCT()
-struct FGradientColorPos
+UENUM()
+enum EColorRampFormat
 {
-	GENERATED_BODY()
-
-	FGradientColorPos() : Color(FLinearColor(1, 1, 1, 1)), Position(0.f) {}
-
-	FGradientColorPos(FLinearColor InColor, float InPosition);
-
-	UPROPERTY(EditAnywhere)
-	FLinearColor Color;
-
-	UPROPERTY(EditAnywhere, meta=(ClampMax=1, ClampMin=0, UIMax=1, UIMin=0))
-	float Position;
-
-	FORCEINLINE bool operator<(const FGradientColorPos& OtherPos) const
-	{
-		return Position < OtherPos.Position;
-	}
+	CRF_AUTO		UMETA(DisplayName = "Auto", ToolTip = "R8 for grayscale ramps, RGBA16F for ramps with values outside 0-1, BGRA8 otherwise."),
+	CRF_BGRA8		UMETA(DisplayName = "BGRA8", ToolTip = "Uncompressed 8 bit color, 4 bytes per texel."),
+	CRF_R8			UMETA(DisplayName = "R8", ToolTip = "8 bit grayscale, 1 byte per texel. Only the red channel of the ramp is kept."),
+	CRF_RGBA16F		UMETA(DisplayName = "RGBA16F", ToolTip = "Half float color, 8 bytes per texel. Not clamped or quantized to 8 bits.")
 };
 
 USTRUCT()
@@ -52,6 +48,8 @@ struct FColorStamp
 	bool SetFromCurve(TObjectPtr<UCurveLinearColor> CurveLinearColor);
 };
 
+// The ColorRampNode module is editor only. Material expressions are never cooked, cooked materials
+// only reference the textures baked by this node.
 UCLASS(DisplayName="ColorRamp")
 class COLORRAMPNODE_API UMaterialExpressionColorRamp : public UMaterialExpression
 {
@@ -62,42 +60,122 @@ public:
 	UPROPERTY(meta = (RequiredInput = "false"))
 	FExpressionInput Factor;
 	
+	/** Row of the texture bound to a parameter ramp, for textures holding several ramps such as a UColorRampAtlas. Only used by parameter ramps, the baked row is sampled if not hooked up. */
+	UPROPERTY(meta = (RequiredInput = "false"))
+	FExpressionInput Row;
+
 	/** only used if Factor is not hooked up */
 	UPROPERTY(EditAnywhere, Category=Default, meta=(OverridingInputProperty = "Factor", EditCondition = "!Factor.IsConnected()"))
 	FLinearColor ConstFac;
 
-	UPROPERTY(EditAnywhere, Category=Gradient)
+	UPROPERTY(EditAnywhere, Category=Gradient, meta=(ToolTip = "Constant ramp textures are sampled without filtering, each step lands on the nearest texel edge."))
 	TEnumAsByte<EColorRampType> RampType = CRT_LINEAR;
 	
+	UPROPERTY(EditAnywhere, Category=Gradient, meta=(ToolTip = "ALU is only used by ramps without a custom curve that are not parameters. Auto stop limit is set in the plugin settings."))
+	TEnumAsByte<EColorRampEvalMode> EvalMode = CREM_TEXTURE;
+
 	UPROPERTY(EditAnywhere, Category=Gradient, DisplayName="sRGB", meta=(EditCondition = "bUseCustomCurveLinearColor == false"))
 	bool bSRGB = false;
 
 	UPROPERTY(EditAnywhere, Category=Gradient, meta=(ToolTip = "Only show linear color gradient.", EditCondition = "bUseCustomCurveLinearColor == false"))
 	FColorStamp ColorStamp;
 
-	UPROPERTY(EditAnywhere, Category=Gradient, AdvancedDisplay, meta=(ToolTip = "Color Gradient Texture Width"))
+	UPROPERTY(EditAnywhere, Category=Gradient, AdvancedDisplay, meta=(ToolTip = "Color Gradient Texture Width, the largest width tried by Auto Resolution"))
 	int32 Resolution = 512;
 
+	UPROPERTY(EditAnywhere, Category=Gradient, AdvancedDisplay, meta=(ToolTip = "Use the narrowest power of two width within the tolerance set in the plugin settings. Constant ramps use the narrowest width with every stop on a texel edge. Not used by custom curves and atlas ramps.", EditCondition = "bUseCustomCurveLinearColor == false"))
+	bool bAutoResolution = false;
+
+	UPROPERTY(EditAnywhere, Category=Gradient, AdvancedDisplay, meta=(ToolTip = "Pixel format of the ramp texture. Atlas ramps are always BGRA8."))
+	TEnumAsByte<EColorRampFormat> Format = CRF_AUTO;
+
 	UPROPERTY(EditAnywhere, Category=CustomCurve)
 	bool bUseCustomCurveLinearColor = false;
 
+	UPROPERTY(EditAnywhere, Category=Parameter, meta=(ToolTip = "Expose the ramp texture to material instances as a texture parameter, defaulting to the baked ramp. Parameter ramps always sample a texture, and Auto format and Auto Resolution fall back to BGRA8 at full width so any ramp texture or UColorRampAtlas can be bound."))
+	bool bIsParameter = false;
+
+	UPROPERTY(EditAnywhere, Category=Parameter, meta=(EditCondition = "bIsParameter"))
+	FName ParameterName = TEXT("Ramp");
+
+	UPROPERTY()
+	FGuid ExpressionGUID;
+
 	UPROPERTY(EditAnywhere, Category=CustomCurve, meta=(EditCondition = "bUseCustomCurveLinearColor"))
 	TObjectPtr<UCurveLinearColor> CustomCurveLinearColor;
 
 	TObjectPtr<UCurveLinearColor> GetCurve();
 
-	void RefreshTexture();
+	/**
+	 * Rebuilds the ramp texture if the ramp changed since the last bake.
+	 *
+	 * @param BakedPixels	Optional texels from BakeRampPixels for ComputeRampKey(), baked here if null
+	 * @param bUseDDC		Look texels up in the derived data cache before baking them. Off for interactive edits.
+	 */
+	void RefreshTexture(const TArray<uint8>* BakedPixels = nullptr, bool bUseDDC = true);
+
+	/** Sorts the stops and reads them back from the curve edited by the gradient widget. */
+	void SyncColorStamp();
+
+	/** Syncs the stops, then rebuilds the texture and curve. BakedPixels and bUseDDC are passed on to RefreshTexture. */
+	void RefreshParameters(const TArray<uint8>* BakedPixels = nullptr, bool bUseDDC = true);
+
+	/**
+	 * Creates the curve and texture if they are missing or stale. Nothing is created when the node is
+	 * constructed, only once it is loaded or Compile, an edit or the details panel needs them.
+	 */
+	void EnsureRampResources();
+
+	/** Current ramp texture without creating it. */
+	UTexture2D* GetRampTexture() const { return TempRampTexPtr; }
+
+	/** Bumped whenever the curve keys may have changed, by the gradient widget, the details panel or undo. */
+	uint32 GetCurveChangeSerial() const { return CurveChangeSerial; }
+
+	// Hash of everything that affects the baked texels.
+	FSHAHash ComputeRampKey() const;
+
+	// True if the ramp samples a texture of its own, neither evaluated in the shader nor packed in an atlas.
+	bool UsesRampTexture() const { return !UseALU() && !UseAtlas(); }
+
+	// Format of the ramp texture, Auto resolved from the stops.
+	EColorRampFormat GetRampFormat() const;
+
+	// Width of the ramp texture, Resolution unless Auto Resolution finds a narrower one.
+	int32 GetRampWidth() const;
+
+	// Fills Width texels of InFormat. Only reads the ramp settings, safe to call from worker threads.
+	void BakeRampPixels(uint8* Pixels, int32 Width, EColorRampFormat InFormat) const;
+
+	/**
+	 * Refreshes several ramps at once. Distinct stale ramps are baked in parallel,
+	 * textures are then created on the game thread in the order of Ramps.
+	 *
+	 * @return	Number of ramp textures baked
+	 */
+	static int32 RefreshRamps(TConstArrayView<UMaterialExpressionColorRamp*> Ramps);
+
+	/** Appends the ColorRamp nodes of a material or material function. */
+	static void GetRamps(UObject* AssetOwner, TArray<UMaterialExpressionColorRamp*>& OutRamps);
 
 	virtual void GetCaption(TArray<FString>& OutCaptions) const override;
 
 	virtual int32 Compile(FMaterialCompiler* Compiler, int32 OutputIndex) override;
 
+	virtual void PostLoad() override;
+
 	virtual UObject* GetReferencedTexture() const override;
 	virtual bool CanReferenceTexture() const override { return true; }
 
 	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
 
-	virtual ~UMaterialExpressionColorRamp() override;
+	virtual void BeginDestroy() override;
+
+	virtual bool HasAParameterName() const override { return bIsParameter; }
+	virtual FName GetParameterName() const override { return ParameterName; }
+	virtual void SetParameterName(const FName& Name) override { ParameterName = Name; }
+	virtual FGuid& GetParameterExpressionId() override { return ExpressionGUID; }
+	virtual bool GetParameterValue(FMaterialParameterMetadata& OutMeta) const override;
 
 private:
 	// TODO: set in plugin settings
@@ -109,27 +187,162 @@ private:
 	UPROPERTY()
 	TObjectPtr<UTexture2D> TempRampTexPtr;
 
+	// Texture this node created in CreateRampTexture, the only one it may rewrite in place. A texture loaded
+	// under its key may be drawn by materials whose shader map came from the DDC and never acquired it.
+	TWeakObjectPtr<UTexture2D> CreatedRampTex;
+
+	// Set while a recompile queued by Compile for a texture created too late is pending.
+	bool bGatherRecompileQueued = false;
+
+	uint32 CurveChangeSerial = 0;
+
 	UPROPERTY()
 	TObjectPtr<UCurveLinearColor> TempCurvePtr;
 
 	bool bValidCurve = false;
 
+	// Key of the shared texture held in FColorRampTextureCache, zero if none is held.
+	FSHAHash RampTexKey;
+
+	// Settings and stops the texels of the held texture were baked from, so a stop edit only re-bakes the texels it touches.
+	struct FBakedRamp
+	{
+		FSHAHash Key;
+		TArray<FGradientColorPos> Stops;
+		int32 Width = 0;
+		EColorRampFormat Format = CRF_BGRA8;
+		EColorRampType RampType = CRT_LINEAR;
+		bool bSRGB = false;
+		bool bAutoResolution = false;
+	};
+	FBakedRamp BakedRamp;
+
+	// Row of this ramp in the material's atlas, and the atlas height.
+	int32 AtlasRow = 0;
+	int32 AtlasNumRows = 1;
+
+	// Row keys and width of the atlas held in TempRampTexPtr, for rewriting only the rows that changed.
+	TArray<FSHAHash> HeldAtlasRowKeys;
+	int32 HeldAtlasWidth = 0;
+
+	// Rows of the atlas shared by all atlas ramps of the owning material, in node order.
+	struct FAtlasLayout
+	{
+		TArray<FSHAHash> RowKeys;
+		TArray<UMaterialExpressionColorRamp*> RowRamps;
+		int32 Width = 0;
+		FSHAHash Key;
+	};
+
+	bool UseAtlas() const { return EvalMode == CREM_ATLAS; }
+
+	bool UseAutoResolution() const { return bAutoResolution && !bUseCustomCurveLinearColor && !UseAtlas() && !bIsParameter; }
+
+	// Time held by each of the Width texels baked for this ramp.
+	FColorRampTexelMapping GetTexelMapping(int32 Width) const;
+
+	// Constant ramps hold one band per texel and are sampled without filtering, so steps stay sharp at any width.
+	// Atlas rows share the filtering of the atlas, custom curves bring their own interpolation.
+	bool UseNearestFilter() const { return RampType == CRT_CONSTANT && !bUseCustomCurveLinearColor && !UseAtlas(); }
+
+	void GetAtlasLayout(FAtlasLayout& OutLayout) const;
+
+	void RefreshAtlas(bool bUseDDC);
+
+	UTexture2D* GenerateAtlasTex(const FAtlasLayout& Layout, bool bUseDDC);
+
+	// Rewrites the edited rows of the atlas held by the material's atlas nodes and moves them all to the
+	// key of Layout. Fails if the row count or width changed, or another material shares the atlas.
+	bool UpdateAtlasInPlace(const FAtlasLayout& Layout);
+
+	// True if the texture and curve match the current ramp settings.
+	bool IsRampUpToDate() const;
+
+	void ReleaseRampTexture();
+
 	FDelegateHandle OnUpdateCurveHandle;
-	void RefreshParameters();
 
-	FColor GetCurrentColor(int32 Pos);
-	void GenerateRampTex(bool bInit = false);
+	// Serial of the latest bake request, shared with bake tasks so superseded ones are dropped.
+	TSharedRef<std::atomic<uint32>, ESPMode::ThreadSafe> LatestBakeSerial = MakeShared<std::atomic<uint32>, ESPMode::ThreadSafe>(0u);
+
+	// Like RefreshParameters, but a texture that needs baking is baked on a worker thread
+	// and committed on the game thread. A newer request supersedes a pending one.
+	void RefreshParametersAsync();
+
+	void CommitAsyncBake(const FSHAHash& Key, const TArray<uint8>& Pixels);
+
+	// Hash of what Compile bakes into the shader: the stops of ALU ramps, atlas rows and the sampled texture.
+	uint32 GetCompiledStateHash() const;
+
+	// Recompiles the owning material, for edits that do not go through PostEditChangeProperty.
+	void RecompileOwner();
+
+	// Recompiles the owner once the open transaction ends, or right away if there is none.
+	// Dragging a stop keeps a transaction open, so the drag recompiles once on release.
+	void RequestRecompile();
+
+	void OnTransactionStateChanged(const FTransactionContext& TransactionContext, ETransactionStateEventType TransactionState);
+
+	void ClearPendingRecompile();
+
+	FDelegateHandle TransactionStateHandle;
+
+	UTexture2D* GenerateRampTex(const FSHAHash& Key, const TArray<uint8>* BakedPixels, bool bUseDDC);
+
+	// Creates the texture asset named TempTextureName from pixels of InFormat baked for Key.
+	UTexture2D* CreateRampTexture(const FSHAHash& Key, EColorRampFormat InFormat, int32 SizeX, int32 SizeY, const uint8* Pixels);
+
+	// Asset textures are found through the package named after their key. A texture rewritten in place
+	// is renamed after its new key, the package saved under the old key keeps the texels of that key.
+	bool CanRenameRampTexture(const FString& NewName) const;
+	void RenameRampTexture(UTexture2D* Texture, const FString& NewName);
+
+	// Rewrites the texels of an existing texture for Key, fails if its size or format differ.
+	bool UpdateRampTexInPlace(UTexture2D* Texture, const FSHAHash& Key, const TArray<uint8>* BakedPixels = nullptr);
+
+	// Remembers what the texels of the held texture were baked from, Key being its key.
+	void RecordBakedRamp(const FSHAHash& Key);
+
+	// Texels [OutBegin, OutEnd) changed by the stop edits since the held texture was baked.
+	// False unless only stops changed and no other node shares the texture.
+	bool GetPartialBakeSpan(int32& OutBegin, int32& OutEnd) const;
+
+	/**
+	 * Re-bakes texels [Begin, End) of the held texture for Key and uploads only those.
+	 * Fails if the texture was not created by CreateRampTexture with the current size and format.
+	 *
+	 * @param BakedPixels	Optional full row from BakeRampPixels, the span is copied from it instead of baked
+	 */
+	bool UpdateRampTexSpan(UTexture2D* Texture, const FSHAHash& Key, int32 Begin, int32 End, const TArray<uint8>* BakedPixels = nullptr);
 
 	void GenerateRampCurve();
+
+	// Unbinds the current curve and lets GC collect it once nothing else references it.
+	void ReleaseRampCurve();
 	
 	int32 Luminance(int32 Input, FMaterialCompiler* Compiler);
 	
 	int32 LinearRamp(int32 Input, FMaterialCompiler* Compiler);
 
+	// True if the ramp is evaluated in the shader instead of sampling TempRampTexPtr.
+	bool UseALU() const;
+
+	// Emits the ramp as a lerp chain over the stops.
+	int32 ALURamp(int32 Input, FMaterialCompiler* Compiler);
+
 	void OnUpdateCurve(UCurveBase* , EPropertyChangeType::Type );
 };
 
 inline void UMaterialExpressionColorRamp::OnUpdateCurve(UCurveBase* , EPropertyChangeType::Type )
 {
-	RefreshParameters();
+	++CurveChangeSerial;
+
+	// Fired for every mouse move while a stop is dragged. Only the texels are updated during the drag,
+	// ALU ramps and atlas rows are part of the shader and recompile once the drag ends.
+	const uint32 CompiledState = GetCompiledStateHash();
+	RefreshParametersAsync();
+	if (GetCompiledStateHash() != CompiledState)
+	{
+		RequestRecompile();
+	}
 }
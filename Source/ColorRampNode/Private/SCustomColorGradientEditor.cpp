@@ -27,6 +27,8 @@
 #include "SCurveEditor.h"
 #include "ScopedTransaction.h"
 #include "Misc/Optional.h"
+#include "Algo/BinarySearch.h"
+#include "ColorRampNodeSettings.h"
 
 #include "SlateOptMacros.h"
 
@@ -45,11 +47,22 @@ void SCustomColorGradientEditor::Construct( const FArguments& InArgs )
 	ViewMaxInput = InArgs._ViewMaxInput;
 	bDraggingAlphaValue = false;
 	bDraggingStop = false;
+	LastCurveNotifyTime = 0.0;
 	DistanceDragged = 0.0f;
 	ContextMenuPosition = FVector2D::ZeroVector;
 	bUseSRGB = InArgs._IsSRGB.Get();
 }
 
+SCustomColorGradientEditor::~SCustomColorGradientEditor()
+{
+	// The timer dies with the widget, send what it was holding back unless the curves are gone too.
+	CurveNotifyTimer.Reset();
+	if( CurveOwnerObject.IsValid() )
+	{
+		FlushCurveChanged();
+	}
+}
+
 int32 SCustomColorGradientEditor::OnPaint( const FPaintArgs& Args, const FGeometry& AllottedGeometry, const FSlateRect& MyCullingRect, FSlateWindowElementList& OutDrawElements, int32 LayerId, const FWidgetStyle& InWidgetStyle, bool bParentEnabled ) const
 {
 	const TSharedRef< FSlateFontMeasure > FontMeasureService = FSlateApplication::Get().GetRenderer()->GetFontMeasureService();
@@ -68,18 +81,14 @@ int32 SCustomColorGradientEditor::OnPaint( const FPaintArgs& Args, const FGeomet
 		// Pixel to value input converter
 		FTrackScaleInfo ScaleInfo(ViewMinInput.Get(),  ViewMaxInput.Get(), 0.0f, 1.0f, GradientAreaGeometry.GetLocalSize());
 
-		// The start and end location in slate units of the area to draw
-		int32 Start = 0;
+		// The end location in slate units of the area to draw
 		int32 Finish = FMath::TruncToInt( AllottedGeometry.GetLocalSize().X );
 
-		TArray<FSlateGradientStop> Stops;
+		// Resample the gradient and stops only when something changed since the last paint
+		UpdatePaintCache( ScaleInfo, Finish );
 
-		// If no alpha keys are available, treat the curve as being completely opaque for drawing purposes
-		bool bHasAnyAlphaKeys = CurveOwner->HasAnyAlphaKeys(); 
-
-		// If any transparency (A < 1) is found, we'll draw a checkerboard to visualize the color with alpha
-		bool bHasTransparency = false;
 		static const FSlateBrush* WhiteBrush = FEditorStyle::GetBrush("WhiteBrush");
+		static const FSlateBrush* CheckerboardBrush = FEditorStyle::GetBrush("Checkerboard");
 
 		if (bColorAreaHovered)
 		{
@@ -110,35 +119,10 @@ int32 SCustomColorGradientEditor::OnPaint( const FPaintArgs& Args, const FGeomet
 			++LayerId;
 		}
 			
-		// Sample the curve every 2 units.  THe curve could be non-linear so sampling at each stop would display an incorrect gradient
-		for( int32 CurrentStep = Start; CurrentStep < Finish; CurrentStep+=2 )
-		{
-			// Figure out the time from the current screen unit
-			float Time = ScaleInfo.LocalXToInput(CurrentStep);
-
-			// Sample the curve
-			FLinearColor Color = CurveOwner->GetLinearColorValue( Time );
-			//Slate MakeGradient call expects the linear colors to be pre-converted to sRGB
-			FColor ColorNosRGB = Color.ToFColor( !(bUseSRGBPtr ? *bUseSRGBPtr : bUseSRGB) );
-			Color = ColorNosRGB.ReinterpretAsLinear();
-			
-			if( !bHasAnyAlphaKeys )
-			{
-				// Only show alpha if there is at least one key.  For some curves, alpha may not be important
-				Color.A = 1.0f;
-				bHasTransparency = false;
-			}
-			else
-			{
-				bHasTransparency |= (Color.A < 1.0f);
-			}
-	
-			Stops.Add( FSlateGradientStop( FVector2D( CurrentStep, 0.0f ), Color ) );
-		}
-
+		const TArray<FSlateGradientStop>& Stops = PaintCache.GradientStops;
 		if( Stops.Num() > 0 )
 		{
-			if( bHasTransparency )
+			if( PaintCache.bHasTransparency )
 			{
 				// Draw a checkerboard behind there is any transparency visible
 				FSlateDrawElement::MakeBox
@@ -146,7 +130,7 @@ int32 SCustomColorGradientEditor::OnPaint( const FPaintArgs& Args, const FGeomet
 					OutDrawElements,
 					LayerId,
 					GradientAreaGeometry.ToPaintGeometry(),
-					FEditorStyle::GetBrush("Checkerboard"),
+					CheckerboardBrush,
 					DrawEffects 
 				);
 			}
@@ -164,23 +148,20 @@ int32 SCustomColorGradientEditor::OnPaint( const FPaintArgs& Args, const FGeomet
 		}
 
 		// Get actual editable stop marks
-		TArray<FGradientStopMark> ColorMarks;
-		TArray<FGradientStopMark> AlphaMarks;
-		GetGradientStopMarks( ColorMarks, AlphaMarks );
+		const TArray<FGradientStopMark>& ColorMarks = PaintCache.ColorMarks;
+		const TArray<FGradientStopMark>& AlphaMarks = PaintCache.AlphaMarks;
 
 		// Draw each color stop
 		for( int32 ColorIndex = 0; ColorIndex < ColorMarks.Num(); ++ColorIndex )
 		{
 			const FGradientStopMark& Mark = ColorMarks[ColorIndex];
 
-			float XVal = ScaleInfo.InputToLocalX( Mark.Time );
+			float XVal = PaintCache.ColorMarkX[ColorIndex];
 
 			// Dont draw stops which are not visible
 			if( XVal >= 0 && XVal <= ColorMarkAreaGeometry.GetLocalSize().X )
 			{
-				FLinearColor Color = CurveOwner->GetLinearColorValue( Mark.Time );
-				Color.A = 1.0f;
-				DrawGradientStopMark( Mark, ColorMarkAreaGeometry, XVal, Color, OutDrawElements, LayerId, MyCullingRect, DrawEffects, true, InWidgetStyle );
+				DrawGradientStopMark( Mark, ColorMarkAreaGeometry, XVal, PaintCache.ColorMarkColors[ColorIndex], OutDrawElements, LayerId, MyCullingRect, DrawEffects, true, InWidgetStyle );
 			}
 		}
 
@@ -189,12 +170,12 @@ int32 SCustomColorGradientEditor::OnPaint( const FPaintArgs& Args, const FGeomet
 		{
 			const FGradientStopMark& Mark = AlphaMarks[ColorIndex];
 
-			float XVal = ScaleInfo.InputToLocalX( Mark.Time );
+			float XVal = PaintCache.AlphaMarkX[ColorIndex];
 		
 			// Dont draw stops which are not visible
 			if( XVal >= 0 && XVal <= AlphaMarkAreaGeometry.GetLocalSize().X )
 			{
-				float Alpha = CurveOwner->GetLinearColorValue( Mark.Time ).A;
+				float Alpha = PaintCache.AlphaMarkValues[ColorIndex];
 				DrawGradientStopMark( Mark, AlphaMarkAreaGeometry, XVal, FLinearColor( Alpha, Alpha, Alpha, 1.0f ), OutDrawElements, LayerId, MyCullingRect, DrawEffects, false, InWidgetStyle );
 			}
 		}
@@ -356,7 +337,8 @@ FReply SCustomColorGradientEditor::OnMouseButtonUp( const FGeometry& MyGeometry,
 		{
 			if( bDraggingStop == true )
 			{
-				// We stopped dragging
+				// We stopped dragging, the final position is always sent
+				FlushCurveChanged();
 				GEditor->EndTransaction();
 			}
 			else if( DistanceDragged < DragThresholdDist && !SelectedStop.IsValid( *CurveOwner ) )
@@ -427,7 +409,14 @@ FVector2D SCustomColorGradientEditor::ComputeDesiredSize( float ) const
 
 void SCustomColorGradientEditor::SetCurveOwner( FCurveOwnerInterface* InCurveOwner ) 
 { 
+	FlushCurveChanged();
 	CurveOwner = InCurveOwner;
+	CurveOwnerObject = CurveOwner && CurveOwner->GetOwners().Num() > 0 ? CurveOwner->GetOwners()[0] : nullptr;
+
+	// The curves live as long as their owner, keep pointers to them for the paint cache signature
+	PaintCache = FPaintCache();
+	PaintCurves = CurveOwner ? CurveOwner->GetCurves() : TArray<FRichCurveEditInfo>();
+	UpdateCurveSignature();
 }
 
 void SCustomColorGradientEditor::SetUseSRGB(bool* sRGB)
@@ -437,6 +426,11 @@ void SCustomColorGradientEditor::SetUseSRGB(bool* sRGB)
 	bUseSRGBPtr = sRGB;
 }
 
+void SCustomColorGradientEditor::SetCurveChangeSerial( const TAttribute<uint32>& InCurveChangeSerial )
+{
+	CurveChangeSerial = InCurveChangeSerial;
+}
+
 void SCustomColorGradientEditor::OpenGradientStopContextMenu(const FPointerEvent& MouseEvent)
 {
 	const FVector2D& Location = MouseEvent.GetScreenSpacePosition();
@@ -584,7 +578,7 @@ void SCustomColorGradientEditor::OnSelectedStopColorChanged( FLinearColor InNewC
 	CurveOwner->ModifyOwner();
 	SelectedStop.SetColor( InNewColor, *CurveOwner );
 	TArray<FRichCurveEditInfo> ChangedCurves{ CurveOwner->GetCurves()[0], CurveOwner->GetCurves()[1], CurveOwner->GetCurves()[2] };
-	CurveOwner->OnCurveChanged(ChangedCurves);
+	SendCurveChanged(ChangedCurves);
 
 	// Set the the last edited color.  The next time a new stop is added we'll use this value
 	LastModifiedColor.R = InNewColor.R;
@@ -597,7 +591,7 @@ void SCustomColorGradientEditor::OnCancelSelectedStopColorChange( FLinearColor P
 	CurveOwner->ModifyOwner();
 	SelectedStop.SetColor( PreviousColor, *CurveOwner );
 	TArray<FRichCurveEditInfo> ChangedCurves{ CurveOwner->GetCurves()[0], CurveOwner->GetCurves()[1], CurveOwner->GetCurves()[2] };
-	CurveOwner->OnCurveChanged(ChangedCurves);
+	SendCurveChanged(ChangedCurves);
 }
 
 void SCustomColorGradientEditor::OnBeginChangeAlphaValue()
@@ -612,6 +606,7 @@ void SCustomColorGradientEditor::OnEndChangeAlphaValue( float NewValue )
 {
 	if( bDraggingAlphaValue )
 	{
+		FlushCurveChanged();
 		GEditor->EndTransaction();
 	}
 
@@ -626,7 +621,7 @@ void SCustomColorGradientEditor::OnAlphaValueChanged( float NewValue )
 		// RGB is ignored in this case
 		SelectedStop.SetColor( FLinearColor( 0,0,0, NewValue ), *CurveOwner );
 		TArray<FRichCurveEditInfo> ChangedCurves{ CurveOwner->GetCurves()[3] };
-		CurveOwner->OnCurveChanged(ChangedCurves);
+		NotifyCurveChanged(ChangedCurves);
 	}
 }
 
@@ -639,13 +634,14 @@ void SCustomColorGradientEditor::OnAlphaValueCommitted( float NewValue, ETextCom
 		CurveOwner->ModifyOwner();
 		SelectedStop.SetColor( FLinearColor( 0,0,0, NewValue ), *CurveOwner );
 		TArray<FRichCurveEditInfo> ChangedCurves{ CurveOwner->GetCurves()[3] };
-		CurveOwner->OnCurveChanged(ChangedCurves);
+		SendCurveChanged(ChangedCurves);
 	}
 	else
 	{
 		SelectedStop.SetColor( FLinearColor( 0,0,0, NewValue ), *CurveOwner );
 		TArray<FRichCurveEditInfo> ChangedCurves{ CurveOwner->GetCurves()[3] };
-		CurveOwner->OnCurveChanged(ChangedCurves);
+		NotifyCurveChanged(ChangedCurves);
+		FlushCurveChanged();
 	}
 
 	// Set the alpha of the last edited color.  The next time a new alpha stop is added we'll use this value
@@ -666,7 +662,7 @@ void SCustomColorGradientEditor::OnSetGradientStopTimeFromPopup( const FText& Ne
 		FScopedTransaction Transaction( LOCTEXT("ChangeGradientStopTime", "Change Gradient Stop Time" ) );
 		CurveOwner->ModifyOwner();
 		SelectedStop.SetTime( NewTime, *CurveOwner );
-		CurveOwner->OnCurveChanged(CurveOwner->GetCurves());
+		SendCurveChanged(CurveOwner->GetCurves());
 	}
 }
 
@@ -726,44 +722,30 @@ FGradientStopMark SCustomColorGradientEditor::GetGradientStopAtPoint( const FVec
 
 	FTrackScaleInfo ScaleInfo(ViewMinInput.Get(),  ViewMaxInput.Get(), 0.0f, 1.0f, MyGeometry.GetLocalSize());
 
-	if( ColorMarkAreaGeometry.IsUnderLocation( MousePos ) || AlphaMarkAreaGeometry.IsUnderLocation( MousePos ) )
+	const bool bInColorArea = ColorMarkAreaGeometry.IsUnderLocation( MousePos );
+	const bool bInAlphaArea = AlphaMarkAreaGeometry.IsUnderLocation( MousePos );
+
+	if( CurveOwner && ( bInColorArea || bInAlphaArea ) )
 	{
-		TArray<FGradientStopMark> ColorMarks;
-		TArray<FGradientStopMark> AlphaMarks;
-		GetGradientStopMarks( ColorMarks, AlphaMarks );
+		// The stop index is only rebuilt if the curves changed since the last paint
+		UpdatePaintCache( ScaleInfo, FMath::TruncToInt( MyGeometry.GetLocalSize().X ) );
 
-		// See if any color stops are under the mouse
-		for( int32 ColorIndex = 0; ColorIndex < ColorMarks.Num(); ++ColorIndex )
+		// Handles span their area vertically, only the marks of the area under the mouse can be hit
+		if( bInColorArea )
 		{
-			const FGradientStopMark& Mark = ColorMarks[ColorIndex];
-
-			// Convert the time to a screen coordinate
-			float XVal = ScaleInfo.InputToLocalX( Mark.Time );
-
-			if( XVal >= 0 )
+			const int32 ColorIndex = FindStopMarkAt( PaintCache.ColorMarkX, ColorMarkAreaGeometry.AbsoluteToLocal( MousePos ).X );
+			if( ColorIndex != INDEX_NONE )
 			{
-				FGeometry MarkGeometry = ColorMarkAreaGeometry.MakeChild( FVector2D( XVal-HandleRect.Left, HandleRect.Top ), FVector2D( HandleRect.Right, HandleRect.Bottom ) );
-				if( MarkGeometry.IsUnderLocation( MousePos ) )
-				{
-					return Mark;
-				}
+				return PaintCache.ColorMarks[ColorIndex];
 			}
 		}
 
-		// See if any color stops are under the mouse
-		for( int32 ColorIndex = 0; ColorIndex < AlphaMarks.Num(); ++ColorIndex )
+		if( bInAlphaArea )
 		{
-			const FGradientStopMark& Mark = AlphaMarks[ColorIndex];
-
-			float XVal = ScaleInfo.InputToLocalX( Mark.Time );
-
-			if( XVal >= 0 )
+			const int32 AlphaIndex = FindStopMarkAt( PaintCache.AlphaMarkX, AlphaMarkAreaGeometry.AbsoluteToLocal( MousePos ).X );
+			if( AlphaIndex != INDEX_NONE )
 			{
-				FGeometry MarkGeometry = AlphaMarkAreaGeometry.MakeChild( FVector2D( XVal-HandleRect.Left, HandleRect.Top ), FVector2D( HandleRect.Right, HandleRect.Bottom ) );
-				if( MarkGeometry.IsUnderLocation( MousePos ) )
-				{
-					return Mark;
-				}
+				return PaintCache.AlphaMarks[AlphaIndex];
 			}
 		}
 	}
@@ -771,6 +753,20 @@ FGradientStopMark SCustomColorGradientEditor::GetGradientStopAtPoint( const FVec
 	return FGradientStopMark();
 }
 
+int32 SCustomColorGradientEditor::FindStopMarkAt( const TArray<float>& MarkX, float LocalX ) const
+{
+	// A handle covers [X - HandleRect.Left, X - HandleRect.Left + HandleRect.Right], marks left of the widget are never hit.
+	// The first mark past the left bound is the lowest one covering LocalX, if any does.
+	const float MinX = LocalX + HandleRect.Left - HandleRect.Right;
+	const int32 Index = MinX < 0.0f ? Algo::LowerBound( MarkX, 0.0f ) : Algo::LowerBound( MarkX, MinX );
+
+	if( MarkX.IsValidIndex( Index ) && MarkX[Index] <= LocalX + HandleRect.Left )
+	{
+		return Index;
+	}
+	return INDEX_NONE;
+}
+
 void SCustomColorGradientEditor::GetGradientStopMarks( TArray<FGradientStopMark>& OutColorMarks, TArray<FGradientStopMark>& OutAlphaMarks ) const
 {
 	TArray<FRichCurveEditInfo> Curves = CurveOwner->GetCurves();
@@ -786,15 +782,41 @@ void SCustomColorGradientEditor::GetGradientStopMarks( TArray<FGradientStopMark>
 	const FRealCurve* AlphaCurve = Curves[3].CurveToEdit;
 
 	
+	// Keys are sorted by time. Walk the green and blue keys along with the red ones instead of searching them for every red key
+	typedef TArray<TPair<float, FKeyHandle>, TInlineAllocator<64>> FTimedKeys;
+	auto GetTimedKeys = []( const FRealCurve* Curve, FTimedKeys& OutKeys )
+	{
+		for( auto It = Curve->GetKeyHandleIterator(); It; ++It )
+		{
+			OutKeys.Emplace( Curve->GetKeyTime( *It ), *It );
+		}
+	};
+	// Same tolerance as FRealCurve::FindKey
+	auto FindKeyAt = []( const FTimedKeys& Keys, int32& Index, float Time )
+	{
+		while( Index < Keys.Num() && Keys[Index].Key < Time - KINDA_SMALL_NUMBER )
+		{
+			++Index;
+		}
+		return Index < Keys.Num() && FMath::Abs( Keys[Index].Key - Time ) <= KINDA_SMALL_NUMBER ? Keys[Index].Value : FKeyHandle::Invalid();
+	};
+
+	FTimedKeys GreenKeys;
+	FTimedKeys BlueKeys;
+	GetTimedKeys( GreenCurve, GreenKeys );
+	GetTimedKeys( BlueCurve, BlueKeys );
+	int32 GreenIndex = 0;
+	int32 BlueIndex = 0;
+
 	// Use the red curve to check the other color channels for keys at the same time
 	for( auto It = RedCurve->GetKeyHandleIterator(); It; ++It )
 	{
 		FKeyHandle RedKeyHandle = *It;
 		float Time = RedCurve->GetKeyTime( RedKeyHandle );
 		
-		FKeyHandle GreenKeyHandle = GreenCurve->FindKey( Time );
+		FKeyHandle GreenKeyHandle = FindKeyAt( GreenKeys, GreenIndex, Time );
 			
-		FKeyHandle BlueKeyHandle = BlueCurve->FindKey( Time );
+		FKeyHandle BlueKeyHandle = FindKeyAt( BlueKeys, BlueIndex, Time );
 
 		if( GreenCurve->IsKeyHandleValid( GreenKeyHandle ) && BlueCurve->IsKeyHandleValid( BlueKeyHandle ) )
 		{
@@ -815,6 +837,180 @@ void SCustomColorGradientEditor::GetGradientStopMarks( TArray<FGradientStopMark>
 	}
 }
 
+void SCustomColorGradientEditor::UpdateCurveSignature()
+{
+	uint32 Signature = 0;
+	for( const FRichCurveEditInfo& Curve : PaintCurves )
+	{
+		const FRealCurve* RealCurve = Curve.CurveToEdit;
+		Signature = HashCombine( Signature, GetTypeHash( RealCurve->GetNumKeys() ) );
+		Signature = HashCombine( Signature, GetTypeHash( RealCurve->GetDefaultValue() ) );
+
+		for( auto It = RealCurve->GetKeyHandleIterator(); It; ++It )
+		{
+			const TPair<float, float> Key = RealCurve->GetKeyTimeValuePair( *It );
+			Signature = HashCombine( Signature, HashCombine( GetTypeHash( Key.Key ), GetTypeHash( Key.Value ) ) );
+			Signature = HashCombine( Signature, GetTypeHash( (uint8)RealCurve->GetKeyInterpMode( *It ) ) );
+		}
+	}
+	CurveSignature = Signature;
+}
+
+void SCustomColorGradientEditor::UpdatePaintCache( const FTrackScaleInfo& ScaleInfo, int32 Finish ) const
+{
+	const bool bSRGB = bUseSRGBPtr ? *bUseSRGBPtr : bUseSRGB;
+
+	// The signature follows edits made here, the serial those made elsewhere, e.g. undo or the details panel
+	const uint32 ChangeSerial = CurveChangeSerial.Get( 0 );
+
+	if( PaintCache.bValid && PaintCache.CurveSignature == CurveSignature && PaintCache.CurveChangeSerial == ChangeSerial && PaintCache.Width == Finish
+		&& PaintCache.bSRGB == bSRGB && PaintCache.ViewMinInput == ViewMinInput.Get() && PaintCache.ViewMaxInput == ViewMaxInput.Get() )
+	{
+		return;
+	}
+
+	PaintCache.bValid = true;
+	PaintCache.CurveSignature = CurveSignature;
+	PaintCache.CurveChangeSerial = ChangeSerial;
+	PaintCache.Width = Finish;
+	PaintCache.bSRGB = bSRGB;
+	PaintCache.ViewMinInput = ViewMinInput.Get();
+	PaintCache.ViewMaxInput = ViewMaxInput.Get();
+
+	// Reset keeps the allocations for the next change
+	PaintCache.GradientStops.Reset();
+	PaintCache.ColorMarks.Reset();
+	PaintCache.AlphaMarks.Reset();
+	PaintCache.ColorMarkColors.Reset();
+	PaintCache.AlphaMarkValues.Reset();
+	PaintCache.ColorMarkX.Reset();
+	PaintCache.AlphaMarkX.Reset();
+
+	// If no alpha keys are available, treat the curve as being completely opaque for drawing purposes
+	const bool bHasAnyAlphaKeys = CurveOwner->HasAnyAlphaKeys();
+
+	// If any transparency (A < 1) is found, we'll draw a checkerboard to visualize the color with alpha
+	PaintCache.bHasTransparency = false;
+
+	// Linear and constant curves are drawn from their keys, anything else is sampled densely
+	if( !AddKeyGradientStops( ScaleInfo, Finish, bSRGB, bHasAnyAlphaKeys ) )
+	{
+		PaintCache.GradientStops.Reset();
+		PaintCache.bHasTransparency = false;
+
+		// Sample the curve every 2 units.  THe curve could be non-linear so sampling at each stop would display an incorrect gradient
+		for( int32 CurrentStep = 0; CurrentStep < Finish; CurrentStep+=2 )
+		{
+			// Figure out the time from the current screen unit
+			float Time = ScaleInfo.LocalXToInput(CurrentStep);
+
+			AddGradientStop( CurrentStep, CurveOwner->GetLinearColorValue( Time ), bSRGB, bHasAnyAlphaKeys );
+		}
+	}
+
+	GetGradientStopMarks( PaintCache.ColorMarks, PaintCache.AlphaMarks );
+
+	// Marks are in key order, their X positions are sorted for FindStopMarkAt
+	for( const FGradientStopMark& Mark : PaintCache.ColorMarks )
+	{
+		FLinearColor Color = CurveOwner->GetLinearColorValue( Mark.Time );
+		Color.A = 1.0f;
+		PaintCache.ColorMarkColors.Add( Color );
+		PaintCache.ColorMarkX.Add( ScaleInfo.InputToLocalX( Mark.Time ) );
+	}
+
+	for( const FGradientStopMark& Mark : PaintCache.AlphaMarks )
+	{
+		PaintCache.AlphaMarkValues.Add( CurveOwner->GetLinearColorValue( Mark.Time ).A );
+		PaintCache.AlphaMarkX.Add( ScaleInfo.InputToLocalX( Mark.Time ) );
+	}
+}
+
+void SCustomColorGradientEditor::AddGradientStop( float XPos, FLinearColor Color, bool bSRGB, bool bHasAnyAlphaKeys ) const
+{
+	//Slate MakeGradient call expects the linear colors to be pre-converted to sRGB
+	FColor ColorNosRGB = Color.ToFColor( !bSRGB );
+	Color = ColorNosRGB.ReinterpretAsLinear();
+
+	if( !bHasAnyAlphaKeys )
+	{
+		// Only show alpha if there is at least one key.  For some curves, alpha may not be important
+		Color.A = 1.0f;
+	}
+	else
+	{
+		PaintCache.bHasTransparency |= (Color.A < 1.0f);
+	}
+
+	PaintCache.GradientStops.Add( FSlateGradientStop( FVector2D( XPos, 0.0f ), Color ) );
+}
+
+bool SCustomColorGradientEditor::AddKeyGradientStops( const FTrackScaleInfo& ScaleInfo, int32 Finish, bool bSRGB, bool bHasAnyAlphaKeys ) const
+{
+	const float ViewMin = ViewMinInput.Get();
+	const float ViewMax = ViewMaxInput.Get();
+
+	// Key times inside the view, the gradient is linear or constant in between
+	TArray<float, TInlineAllocator<64>> Times;
+	for( const FRichCurveEditInfo& Curve : PaintCurves )
+	{
+		const FRealCurve* RealCurve = Curve.CurveToEdit;
+		for( auto It = RealCurve->GetKeyHandleIterator(); It; ++It )
+		{
+			const ERichCurveInterpMode InterpMode = RealCurve->GetKeyInterpMode( *It );
+			if( InterpMode != RCIM_Linear && InterpMode != RCIM_Constant )
+			{
+				return false;
+			}
+
+			const float Time = RealCurve->GetKeyTime( *It );
+			if( Time > ViewMin && Time < ViewMax )
+			{
+				Times.Add( Time );
+			}
+		}
+	}
+	Times.Add( ViewMax );
+	Times.Sort();
+
+	// Slate interpolates the converted colors, while the widget shows each sample sRGB encoded.
+	// Encoded segments are curved and get a few stops in between.
+	const int32 NumSteps = bSRGB ? 1 : 8;
+
+	AddGradientStop( ScaleInfo.InputToLocalX( ViewMin ), CurveOwner->GetLinearColorValue( ViewMin ), bSRGB, bHasAnyAlphaKeys );
+
+	float PrevTime = ViewMin;
+	for( float Time : Times )
+	{
+		if( Time <= PrevTime )
+		{
+			continue;
+		}
+
+		const float Span = Time - PrevTime;
+		for( int32 Step = 1; Step < NumSteps; ++Step )
+		{
+			const float StepTime = PrevTime + Span * Step / NumSteps;
+			AddGradientStop( ScaleInfo.InputToLocalX( StepTime ), CurveOwner->GetLinearColorValue( StepTime ), bSRGB, bHasAnyAlphaKeys );
+		}
+
+		// Constant keys jump at their time, the color just before it closes the previous segment
+		const float XPos = ScaleInfo.InputToLocalX( Time );
+		const FLinearColor Before = CurveOwner->GetLinearColorValue( Time - Span * 0.001f );
+		const FLinearColor At = CurveOwner->GetLinearColorValue( Time );
+		if( !Before.Equals( At, 1.0f / 255.0f ) )
+		{
+			AddGradientStop( XPos, Before, bSRGB, bHasAnyAlphaKeys );
+		}
+		AddGradientStop( XPos, At, bSRGB, bHasAnyAlphaKeys );
+
+		PrevTime = Time;
+	}
+
+	// Not worth it once keys are denser than the sampling
+	return PaintCache.GradientStops.Num() <= FMath::Max( Finish / 2, 2 );
+}
+
 void SCustomColorGradientEditor::DeleteStop( const FGradientStopMark& InMark )
 {
 	FScopedTransaction DeleteStopTrans( LOCTEXT("DeleteGradientStop", "Delete Gradient Stop") );
@@ -838,7 +1034,7 @@ void SCustomColorGradientEditor::DeleteStop( const FGradientStopMark& InMark )
 		BlueCurve->DeleteKey( InMark.BlueKeyHandle );
 	}
 
-	CurveOwner->OnCurveChanged(CurveOwner->GetCurves());
+	SendCurveChanged(CurveOwner->GetCurves());
 }
 
 FGradientStopMark SCustomColorGradientEditor::AddStop( const FVector2D& Position, const FGeometry& MyGeometry, bool bColorStop )
@@ -874,7 +1070,7 @@ FGradientStopMark SCustomColorGradientEditor::AddStop( const FVector2D& Position
 		NewStop.AlphaKeyHandle = AlphaCurve->AddKey( NewStopTime, LastModifiedColor.A );
 	}
 
-	CurveOwner->OnCurveChanged(CurveOwner->GetCurves());
+	SendCurveChanged(CurveOwner->GetCurves());
 
 	return NewStop;
 }
@@ -883,7 +1079,63 @@ void SCustomColorGradientEditor::MoveStop( FGradientStopMark& Mark, float NewTim
 {
 	CurveOwner->ModifyOwner();
 	Mark.SetTime( NewTime, *CurveOwner );
-	CurveOwner->OnCurveChanged(CurveOwner->GetCurves());
+	NotifyCurveChanged(CurveOwner->GetCurves());
+}
+
+void SCustomColorGradientEditor::NotifyCurveChanged( const TArray<FRichCurveEditInfo>& ChangedCurves )
+{
+	UpdateCurveSignature();
+
+	for( const FRichCurveEditInfo& Curve : ChangedCurves )
+	{
+		PendingChangedCurves.AddUnique( Curve );
+	}
+
+	// The curve keys are already edited, only the notification waits. The last one always sees the final keys.
+	const float NotifyRate = GetDefault<UColorRampNodeSettings>()->GradientNotifyRate;
+	const double Now = FPlatformTime::Seconds();
+	if( NotifyRate <= 0.0f || Now - LastCurveNotifyTime >= 1.0 / NotifyRate )
+	{
+		FlushCurveChanged();
+	}
+	else if( !CurveNotifyTimer.IsValid() )
+	{
+		const float Delay = float( LastCurveNotifyTime + 1.0 / NotifyRate - Now );
+		CurveNotifyTimer = RegisterActiveTimer( Delay, FWidgetActiveTimerDelegate::CreateSP( this, &SCustomColorGradientEditor::OnCurveNotifyTimer ) );
+	}
+}
+
+void SCustomColorGradientEditor::FlushCurveChanged()
+{
+	if( CurveNotifyTimer.IsValid() )
+	{
+		UnRegisterActiveTimer( CurveNotifyTimer.ToSharedRef() );
+		CurveNotifyTimer.Reset();
+	}
+
+	if( PendingChangedCurves.Num() > 0 && CurveOwner )
+	{
+		TArray<FRichCurveEditInfo> ChangedCurves = MoveTemp( PendingChangedCurves );
+		PendingChangedCurves.Reset();
+
+		LastCurveNotifyTime = FPlatformTime::Seconds();
+		CurveOwner->OnCurveChanged( ChangedCurves );
+	}
+}
+
+void SCustomColorGradientEditor::SendCurveChanged( const TArray<FRichCurveEditInfo>& ChangedCurves )
+{
+	UpdateCurveSignature();
+	FlushCurveChanged();
+	CurveOwner->OnCurveChanged( ChangedCurves );
+}
+
+EActiveTimerReturnType SCustomColorGradientEditor::OnCurveNotifyTimer( double InCurrentTime, float InDeltaTime )
+{
+	CurveNotifyTimer.Reset();
+	FlushCurveChanged();
+
+	return EActiveTimerReturnType::Stop;
 }
 
 END_SLATE_FUNCTION_BUILD_OPTIMIZATION
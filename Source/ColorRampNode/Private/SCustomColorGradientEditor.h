@@ -5,10 +5,16 @@
 
 #include "CoreMinimal.h"
 #include "SColorGradientEditor.h"
+#include "Rendering/DrawElements.h"
 #include "Widgets/SLeafWidget.h"
 
+struct FTrackScaleInfo;
+
 class COLORRAMPNODE_API SCustomColorGradientEditor : public SLeafWidget
 {
+	/** Times the paint cache rebuild */
+	friend class UColorRampBenchmarkCommandlet;
+
 public:
 	SLATE_BEGIN_ARGS( SCustomColorGradientEditor ) 
 		: _ViewMinInput(0.0f)
@@ -25,6 +31,9 @@ public:
 
 	void Construct( const FArguments& InArgs );
 
+	/** Sends a change still held back by NotifyCurveChanged, e.g. when the details panel rebuilds */
+	virtual ~SCustomColorGradientEditor();
+
 	/** SWidget Interface */
 	virtual bool SupportsKeyboardFocus() const override { return true; }
 	virtual int32 OnPaint( const FPaintArgs& Args, const FGeometry& AllottedGeometry, const FSlateRect& MyCullingRect, FSlateWindowElementList& OutDrawElements, int32 LayerId, const FWidgetStyle& InWidgetStyle, bool bParentEnabled ) const override;
@@ -45,6 +54,13 @@ public:
 
 	void SetUseSRGB(bool* sRGB);
 
+	/**
+	 * Sets a counter the curve owner bumps when the curves change outside this editor, e.g. on undo
+	 *
+	 * @param InCurveChangeSerial	Read on paint, the paint cache is rebuilt when it changes
+	 */
+	void SetCurveChangeSerial( const TAttribute<uint32>& InCurveChangeSerial );
+
 private:
 	/**
 	 * Opens a context menu with options for the selected gradient stop
@@ -143,6 +159,15 @@ private:
 	 */
 	FGradientStopMark GetGradientStopAtPoint( const FVector2D& MousePos, const FGeometry& MyGeometry );
 
+	/**
+	 * Binary searches the handles of sorted marks
+	 *
+	 * @param MarkX		Local X of each mark, sorted
+	 * @param LocalX	Local X in the mark area to test
+	 * @return			Index of the first mark whose handle covers LocalX, or INDEX_NONE
+	 */
+	int32 FindStopMarkAt( const TArray<float>& MarkX, float LocalX ) const;
+
 	/**
 	 * Get all gradient stop marks on the curve
 	 */
@@ -172,6 +197,54 @@ private:
 	 */
 	void MoveStop( FGradientStopMark& Mark, float NewTime );
 
+	/**
+	 * Notifies the curve owner of a change made while dragging, at most GradientNotifyRate times a second.
+	 * Held back changes are sent when the window ends or by FlushCurveChanged.
+	 *
+	 * @param ChangedCurves	The curves that changed
+	 */
+	void NotifyCurveChanged( const TArray<FRichCurveEditInfo>& ChangedCurves );
+
+	/**
+	 * Sends the change held back by NotifyCurveChanged, if any
+	 */
+	void FlushCurveChanged();
+
+	/**
+	 * Notifies the curve owner right away, after any held back change so the owner sees them in order
+	 *
+	 * @param ChangedCurves	The curves that changed
+	 */
+	void SendCurveChanged( const TArray<FRichCurveEditInfo>& ChangedCurves );
+
+	EActiveTimerReturnType OnCurveNotifyTimer( double InCurrentTime, float InDeltaTime );
+
+	/**
+	 * Rehashes the keys of the edited curves into CurveSignature. Called when the curves change instead of
+	 * on every paint and hit test.
+	 */
+	void UpdateCurveSignature();
+
+	/**
+	 * Resamples the gradient and stop marks drawn by OnPaint if the curves, width, view range or sRGB flag changed
+	 *
+	 * @param ScaleInfo	Pixel to value input converter of the gradient area
+	 * @param Finish	Width of the area to draw in slate units
+	 */
+	void UpdatePaintCache( const FTrackScaleInfo& ScaleInfo, int32 Finish ) const;
+
+	/**
+	 * Adds one gradient stop to the paint cache, converting the color the way Slate expects it
+	 */
+	void AddGradientStop( float XPos, FLinearColor Color, bool bSRGB, bool bHasAnyAlphaKeys ) const;
+
+	/**
+	 * Adds gradient stops at the curve keys, with hard edges at constant keys
+	 *
+	 * @return	False if a curve has keys that are neither linear nor constant, or the keys are denser than dense sampling
+	 */
+	bool AddKeyGradientStops( const FTrackScaleInfo& ScaleInfo, int32 Finish, bool bSRGB, bool bHasAnyAlphaKeys ) const;
+
 private:
 	/** Local space rectangle of each gradient stop handle */
 	static const FSlateRect HandleRect;
@@ -182,6 +255,8 @@ private:
 	FLinearColor LastModifiedColor;
 	/** interface to the curves being edited */
 	FCurveOwnerInterface* CurveOwner;
+	/** Object owning the edited curves, tells whether CurveOwner is still alive when the widget is destroyed */
+	TWeakObjectPtr<const UObject> CurveOwnerObject;
 	/** Current min input value that is visible */
 	TAttribute<float> ViewMinInput;
 	/** Current max input value that is visible */
@@ -200,6 +275,40 @@ private:
 	bool bDraggingAlphaValue;
 	/** True if a gradient stop is being dragged */
 	bool bDraggingStop;
+	/** Curves changed since the last notification */
+	TArray<FRichCurveEditInfo> PendingChangedCurves;
+	/** Time of the last notification sent to the curve owner */
+	double LastCurveNotifyTime;
+	/** Timer sending a held back notification at the end of its window */
+	TSharedPtr<FActiveTimerHandle> CurveNotifyTimer;
+
+	/** What OnPaint draws and GetGradientStopAtPoint hit tests, reused until the curves or the widget change */
+	struct FPaintCache
+	{
+		bool bValid = false;
+		uint32 CurveSignature = 0;
+		uint32 CurveChangeSerial = 0;
+		int32 Width = 0;
+		bool bSRGB = false;
+		float ViewMinInput = 0.0f;
+		float ViewMaxInput = 0.0f;
+		bool bHasTransparency = false;
+		TArray<FSlateGradientStop> GradientStops;
+		TArray<FGradientStopMark> ColorMarks;
+		TArray<FGradientStopMark> AlphaMarks;
+		TArray<FLinearColor> ColorMarkColors;
+		TArray<float> AlphaMarkValues;
+		/** Local X of each mark, sorted like the marks */
+		TArray<float> ColorMarkX;
+		TArray<float> AlphaMarkX;
+	};
+	mutable FPaintCache PaintCache;
+	/** Curves of the owner, read for the paint cache signature */
+	TArray<FRichCurveEditInfo> PaintCurves;
+	/** Hash of the keys of PaintCurves, changes whenever a stop is added, moved, removed or recolored */
+	uint32 CurveSignature = 0;
+	/** Counter of the curve owner, changes whenever the curves change outside this editor */
+	TAttribute<uint32> CurveChangeSerial;
 
 	bool bUseSRGB;
 	bool* bUseSRGBPtr;
@@ -0,0 +1,143 @@
+﻿#include "ColorRampAtlas.h"
+
+#include "Curves/CurveLinearColor.h"
+#include "Engine/Texture2D.h"
+#include "Materials/MaterialInstanceDynamic.h"
+#include "ColorRampEvaluator.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogColorRampAtlas, Log, All);
+
+UColorRampAtlas* UColorRampAtlas::CreateColorRampAtlas(UObject* Outer, int32 Width, int32 NumRows)
+{
+	UColorRampAtlas* Atlas = NewObject<UColorRampAtlas>(Outer ? Outer : GetTransientPackage());
+	Atlas->Width = FMath::Max(Width, 1);
+	Atlas->NumRows = FMath::Max(NumRows, 1);
+	Atlas->Texels.Init(FColor::Black, Atlas->Width * Atlas->NumRows);
+	Atlas->UsedRows.Init(false, Atlas->NumRows);
+
+	// Same sampling as the ramp textures of the nodes. Never streamed, rows are patched on the GPU copy.
+	UTexture2D* NewTexture = UTexture2D::CreateTransient(Atlas->Width, Atlas->NumRows, PF_B8G8R8A8);
+	NewTexture->Filter = TF_Bilinear;
+	NewTexture->SRGB = 0;
+	NewTexture->LODGroup = TEXTUREGROUP_ColorLookupTable;
+	NewTexture->NeverStream = true;
+	NewTexture->AddressX = TA_Clamp;
+	NewTexture->AddressY = TA_Clamp;
+
+	FTexture2DMipMap& Mip = NewTexture->GetPlatformData()->Mips[0];
+	FMemory::Memcpy(Mip.BulkData.Lock(LOCK_READ_WRITE), Atlas->Texels.GetData(), Atlas->Texels.Num() * sizeof(FColor));
+	Mip.BulkData.Unlock();
+	NewTexture->UpdateResource();
+
+	Atlas->Texture = NewTexture;
+	return Atlas;
+}
+
+int32 UColorRampAtlas::AllocateRow()
+{
+	const int32 Row = UsedRows.Find(false);
+	if (Row != INDEX_NONE)
+	{
+		UsedRows[Row] = true;
+	}
+	return Row;
+}
+
+void UColorRampAtlas::FreeRow(int32 Row)
+{
+	if (IsValidRow(Row))
+	{
+		UsedRows[Row] = false;
+	}
+}
+
+void UColorRampAtlas::SetRowStops(int32 Row, const TArray<FGradientColorPos>& Stops, TEnumAsByte<EColorRampType> RampType, bool bSRGB)
+{
+	if (!IsValidRow(Row) || Stops.Num() == 0)
+	{
+		UE_LOG(LogColorRampAtlas, Warning, TEXT("SetRowStops: invalid row %d or no stops."), Row);
+		return;
+	}
+
+	TArray<FGradientColorPos> SortedStops = Stops;
+	SortedStops.Sort();
+
+	// Encoded like the texture of a node, sampled like one without Auto Resolution.
+	FColorRampEvaluator Evaluator(SortedStops, RampType, !bSRGB);
+	FColor* RowTexels = GetRowTexels(Row);
+	Evaluator.Bake(Width, FColorRampTexelMapping::Start(Width), RowTexels);
+
+	UploadRow(Row);
+}
+
+void UColorRampAtlas::SetRowCurve(int32 Row, UCurveLinearColor* Curve)
+{
+	if (!IsValidRow(Row) || !IsValid(Curve))
+	{
+		UE_LOG(LogColorRampAtlas, Warning, TEXT("SetRowCurve: invalid row %d or curve."), Row);
+		return;
+	}
+
+	FColorRampTexels::BakeCurve(Curve, Width, PF_B8G8R8A8, reinterpret_cast<uint8*>(GetRowTexels(Row)));
+
+	UploadRow(Row);
+}
+
+void UColorRampAtlas::BlendRows(int32 Row, int32 RowA, int32 RowB, float Alpha)
+{
+	if (!IsValidRow(Row) || !IsValidRow(RowA) || !IsValidRow(RowB))
+	{
+		UE_LOG(LogColorRampAtlas, Warning, TEXT("BlendRows: invalid rows %d, %d, %d."), Row, RowA, RowB);
+		return;
+	}
+
+	// Blends the stored texels, cheaper than baking the stops of both ramps again.
+	const int32 Weight = FMath::RoundToInt(FMath::Clamp(Alpha, 0.f, 1.f) * 256.f);
+	const FColor* A = GetRowTexels(RowA);
+	const FColor* B = GetRowTexels(RowB);
+	FColor* Out = GetRowTexels(Row);
+	auto Blend = [Weight](uint8 From, uint8 To) { return uint8((From * (256 - Weight) + To * Weight + 128) >> 8); };
+	for (int32 x = 0; x < Width; x++)
+	{
+		Out[x] = FColor(Blend(A[x].R, B[x].R), Blend(A[x].G, B[x].G), Blend(A[x].B, B[x].B), Blend(A[x].A, B[x].A));
+	}
+
+	UploadRow(Row);
+}
+
+void UColorRampAtlas::BindRow(UMaterialInstanceDynamic* Instance, FName TextureParameterName, FName RowParameterName, int32 Row) const
+{
+	if (!IsValid(Instance))
+	{
+		return;
+	}
+
+	Instance->SetTextureParameterValue(TextureParameterName, Texture);
+	Instance->SetScalarParameterValue(RowParameterName, float(Row));
+}
+
+void UColorRampAtlas::UploadRow(int32 Row)
+{
+	if (!Texture)
+	{
+		return;
+	}
+
+	// Creating the resource may have discarded the bulk data, it is then restored from the CPU copy.
+	const int32 NumBytes = Width * sizeof(FColor);
+	FTexture2DMipMap& Mip = Texture->GetPlatformData()->Mips[0];
+	uint8* MipTexels = static_cast<uint8*>(Mip.BulkData.Lock(LOCK_READ_WRITE));
+	if (Mip.BulkData.GetBulkDataSize() != Texels.Num() * sizeof(FColor))
+	{
+		MipTexels = static_cast<uint8*>(Mip.BulkData.Realloc(Texels.Num() * sizeof(FColor)));
+		FMemory::Memcpy(MipTexels, Texels.GetData(), Texels.Num() * sizeof(FColor));
+	}
+	else
+	{
+		FMemory::Memcpy(MipTexels + Row * NumBytes, GetRowTexels(Row), NumBytes);
+	}
+	Mip.BulkData.Unlock();
+
+	// A new resource is built with every row from the platform data.
+	FColorRampTexels::UploadTexelSpan(Texture, Row, 0, Width, sizeof(FColor), reinterpret_cast<const uint8*>(GetRowTexels(Row)));
+}
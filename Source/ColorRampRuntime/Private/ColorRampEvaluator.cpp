@@ -0,0 +1,394 @@
+﻿#include "ColorRampEvaluator.h"
+
+#include "Algo/BinarySearch.h"
+#include "Async/ParallelFor.h"
+#include "Curves/CurveLinearColor.h"
+#include "Engine/Texture2D.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/Float16Color.h"
+#include "Math/VectorRegister.h"
+
+static TAutoConsoleVariable<bool> CVarColorRampBakeSIMD(
+	TEXT("ColorRamp.BakeSIMD"),
+	true,
+	TEXT("Bake linear ramp texels four at a time with the vector kernel. 0 uses the scalar path."));
+
+static constexpr float SRGBLinearThreshold = 0.0031308f;
+static constexpr float SRGBLinearScale = 12.92f;
+
+// Texels per ParallelFor task when baking wide ramps.
+static constexpr int32 BakeChunkTexels = 4096;
+
+// Texels are quantized with the engine's own encode, FLinearColor::ToFColor, so baked ramps match
+// curve bakes and the gradient widget bit for bit. Interpolation keeps the same operation order in
+// the scalar and vector paths, each step is a separate statement so the compiler cannot contract them.
+static FORCEINLINE FColor QuantizeColor(const FLinearColor& Color, bool bEncodeSRGB)
+{
+	// Alpha is never sRGB encoded.
+	return Color.ToFColor(bEncodeSRGB);
+}
+
+// ToFColorSRGB clamps to [2^-13, 1) and only reads the float bits above the lowest 12, the vector kernel
+// looks the encoded channel up by those bits. Filled from ToFColorSRGB itself, so it cannot drift from the engine.
+static constexpr uint32 SRGBTableMinBits = (127 - 13) << 23;
+static constexpr uint32 SRGBTableMaxBits = 0x3f7fffff;
+static constexpr int32 SRGBTableShift = 12;
+
+static const uint8* GetSRGBTable()
+{
+	static const TArray<uint8> Table = []()
+	{
+		TArray<uint8> Entries;
+		Entries.SetNumUninitialized(((SRGBTableMaxBits - SRGBTableMinBits) >> SRGBTableShift) + 1);
+		for (int32 Index = 0; Index < Entries.Num(); ++Index)
+		{
+			const float Value = FMath::AsFloat(SRGBTableMinBits + (uint32(Index) << SRGBTableShift));
+			Entries[Index] = FLinearColor(Value, 0.f, 0.f, 0.f).ToFColorSRGB().R;
+		}
+		return Entries;
+	}();
+	return Table.GetData();
+}
+
+// Exact sRGB curve without the upper clamp, float textures keep values above one.
+FLinearColor FColorRampEvaluator::EncodeLinear(const FLinearColor& Color, bool bEncodeSRGB)
+{
+	if (!bEncodeSRGB)
+	{
+		return Color;
+	}
+
+	auto LinearToSRGB = [](float Value)
+	{
+		Value = FMath::Max(Value, 0.f);
+		return Value <= SRGBLinearThreshold ? Value * SRGBLinearScale : FMath::Pow(Value, 1.f / 2.4f) * 1.055f - 0.055f;
+	};
+
+	return FLinearColor(LinearToSRGB(Color.R), LinearToSRGB(Color.G), LinearToSRGB(Color.B), Color.A);
+}
+
+FColorRampEvaluator::FColorRampEvaluator(TArrayView<const FGradientColorPos> SortedStops, EColorRampType InRampType, bool bInEncodeSRGB)
+	: RampType(InRampType)
+	, bEncodeSRGB(bInEncodeSRGB)
+{
+	if (SortedStops.Num() == 0)
+	{
+		return;
+	}
+
+	FirstPosition = SortedStops[0].Position;
+	LastPosition = SortedStops.Last().Position;
+	FirstTexel = QuantizeColor(SortedStops[0].Color, bEncodeSRGB);
+	LastTexel = QuantizeColor(SortedStops.Last().Color, bEncodeSRGB);
+	FirstColor = EncodeLinear(SortedStops[0].Color, bEncodeSRGB);
+	LastColor = EncodeLinear(SortedStops.Last().Color, bEncodeSRGB);
+
+	Segments.Reserve(SortedStops.Num() - 1);
+	for (int32 i = 0; i + 1 < SortedStops.Num(); ++i)
+	{
+		const FGradientColorPos& From = SortedStops[i];
+		const FGradientColorPos& To = SortedStops[i + 1];
+
+		// Stops at the same position leave no time for a segment in between.
+		if (To.Position <= From.Position)
+		{
+			continue;
+		}
+
+		FSegment& Segment = Segments.AddDefaulted_GetRef();
+		Segment.Start = From.Position;
+		Segment.End = To.Position;
+		Segment.InvSpan = 1.f / (To.Position - From.Position);
+		Segment.Color = From.Color;
+		Segment.Delta = To.Color - From.Color;
+		Segment.ConstantTexel = QuantizeColor(From.Color, bEncodeSRGB);
+	}
+}
+
+FColor FColorRampEvaluator::Shade(const FSegment& Segment, float Time) const
+{
+	if (RampType == CRT_CONSTANT)
+	{
+		return Segment.ConstantTexel;
+	}
+
+	// Same operation order as BakeSegmentVectorized.
+	const float Offset = Time - Segment.Start;
+	const float Progress = Offset * Segment.InvSpan;
+
+	FLinearColor Color;
+	for (int32 Channel = 0; Channel < 4; ++Channel)
+	{
+		const float Step = Segment.Delta.Component(Channel) * Progress;
+		Color.Component(Channel) = Segment.Color.Component(Channel) + Step;
+	}
+
+	return QuantizeColor(Color, bEncodeSRGB);
+}
+
+FLinearColor FColorRampEvaluator::ShadeLinear(const FSegment& Segment, float Time) const
+{
+	if (RampType == CRT_CONSTANT)
+	{
+		return EncodeLinear(Segment.Color, bEncodeSRGB);
+	}
+
+	const float Progress = (Time - Segment.Start) * Segment.InvSpan;
+	return EncodeLinear(Segment.Color + Segment.Delta * Progress, bEncodeSRGB);
+}
+
+FColor FColorRampEvaluator::Evaluate(float Time) const
+{
+	if (Time <= FirstPosition)
+	{
+		return FirstTexel;
+	}
+
+	if (Time > LastPosition || Segments.Num() == 0)
+	{
+		return LastTexel;
+	}
+
+	// First segment whose (Start, End] range contains Time.
+	const int32 Index = Algo::LowerBoundBy(Segments, Time, &FSegment::End);
+	return Shade(Segments[FMath::Min(Index, Segments.Num() - 1)], Time);
+}
+
+FLinearColor FColorRampEvaluator::EvaluateLinear(float Time) const
+{
+	if (Time <= FirstPosition)
+	{
+		return FirstColor;
+	}
+
+	if (Time > LastPosition || Segments.Num() == 0)
+	{
+		return LastColor;
+	}
+
+	const int32 Index = Algo::LowerBoundBy(Segments, Time, &FSegment::End);
+	return ShadeLinear(Segments[FMath::Min(Index, Segments.Num() - 1)], Time);
+}
+
+void FColorRampEvaluator::BakeLinear(int32 Begin, int32 End, const FColorRampTexelMapping& Mapping, FLinearColor* OutTexels) const
+{
+	int32 Index = Algo::LowerBoundBy(Segments, Mapping.GetTime(Begin), &FSegment::End);
+	for (int32 x = Begin; x < End; ++x)
+	{
+		const float Time = Mapping.GetTime(x);
+
+		if (Time <= FirstPosition)
+		{
+			OutTexels[x] = FirstColor;
+		}
+		else if (Time > LastPosition || Segments.Num() == 0)
+		{
+			OutTexels[x] = LastColor;
+		}
+		else
+		{
+			while (Segments[Index].End < Time)
+			{
+				++Index;
+			}
+			OutTexels[x] = ShadeLinear(Segments[Index], Time);
+		}
+	}
+}
+
+void FColorRampEvaluator::Bake(int32 Width, const FColorRampTexelMapping& Mapping, FColor* OutTexels) const
+{
+	BakeSpan(0, Width, Mapping, OutTexels);
+}
+
+void FColorRampEvaluator::BakeSpan(int32 Begin, int32 End, const FColorRampTexelMapping& Mapping, FColor* OutTexels) const
+{
+	// Wide spans are split into chunks baked on worker threads, narrow ones stay on the calling thread.
+	const int32 NumChunks = FMath::DivideAndRoundUp(End - Begin, BakeChunkTexels);
+	ParallelFor(NumChunks, [this, Begin, End, &Mapping, OutTexels](int32 Chunk)
+	{
+		const int32 ChunkBegin = Begin + Chunk * BakeChunkTexels;
+		BakeRange(Mapping, ChunkBegin, FMath::Min(ChunkBegin + BakeChunkTexels, End), OutTexels);
+	});
+}
+
+void FColorRampEvaluator::BakeScalar(int32 Width, const FColorRampTexelMapping& Mapping, FColor* OutTexels) const
+{
+	BakeScalarRange(Mapping, 0, Width, OutTexels);
+}
+
+void FColorRampEvaluator::BakeRange(const FColorRampTexelMapping& Mapping, int32 Begin, int32 End, FColor* OutTexels) const
+{
+	if (!CVarColorRampBakeSIMD.GetValueOnAnyThread() || RampType != CRT_LINEAR)
+	{
+		BakeScalarRange(Mapping, Begin, End, OutTexels);
+		return;
+	}
+
+	int32 x = Begin;
+	while (x < End && Mapping.GetTime(x) <= FirstPosition)
+	{
+		OutTexels[x++] = FirstTexel;
+	}
+
+	for (int32 Index = Algo::LowerBoundBy(Segments, Mapping.GetTime(x), &FSegment::End); Index < Segments.Num() && x < End; ++Index)
+	{
+		const FSegment& Segment = Segments[Index];
+
+		int32 SegmentEnd = x;
+		while (SegmentEnd < End && Mapping.GetTime(SegmentEnd) <= Segment.End)
+		{
+			++SegmentEnd;
+		}
+
+		BakeSegmentVectorized(Segment, Mapping, x, SegmentEnd, OutTexels);
+		x = SegmentEnd;
+	}
+
+	while (x < End)
+	{
+		OutTexels[x++] = LastTexel;
+	}
+}
+
+void FColorRampEvaluator::BakeScalarRange(const FColorRampTexelMapping& Mapping, int32 Begin, int32 End, FColor* OutTexels) const
+{
+	int32 Index = Algo::LowerBoundBy(Segments, Mapping.GetTime(Begin), &FSegment::End);
+	for (int32 x = Begin; x < End; ++x)
+	{
+		const float Time = Mapping.GetTime(x);
+
+		if (Time <= FirstPosition)
+		{
+			OutTexels[x] = FirstTexel;
+		}
+		else if (Time > LastPosition || Segments.Num() == 0)
+		{
+			OutTexels[x] = LastTexel;
+		}
+		else
+		{
+			// Time only grows, the current segment never moves backwards.
+			while (Segments[Index].End < Time)
+			{
+				++Index;
+			}
+			OutTexels[x] = Shade(Segments[Index], Time);
+		}
+	}
+}
+
+void FColorRampEvaluator::BakeSegmentVectorized(const FSegment& Segment, const FColorRampTexelMapping& Mapping, int32 Begin, int32 End, FColor* OutTexels) const
+{
+	const VectorRegister4Float OffsetV = VectorSetFloat1(Mapping.Offset);
+	const VectorRegister4Float StepV = VectorSetFloat1(Mapping.Step);
+	const VectorRegister4Float StartV = VectorSetFloat1(Segment.Start);
+	const VectorRegister4Float InvSpanV = VectorSetFloat1(Segment.InvSpan);
+	const VectorRegister4Float Four = VectorSetFloat1(4.f);
+
+	VectorRegister4Float ColorV[4];
+	VectorRegister4Float DeltaV[4];
+	for (int32 Channel = 0; Channel < 4; ++Channel)
+	{
+		ColorV[Channel] = VectorSetFloat1(Segment.Color.Component(Channel));
+		DeltaV[Channel] = VectorSetFloat1(Segment.Delta.Component(Channel));
+	}
+
+	// Same quantization as ToFColor(false): clamp, scale by 255.999 and truncate.
+	const VectorRegister4Float Zero = VectorZeroFloat();
+	const VectorRegister4Float One = VectorOneFloat();
+	const VectorRegister4Float Scale = VectorSetFloat1(255.999f);
+
+	// Same encode as ToFColorSRGB, through the table indexed by the clamped float bits.
+	const uint8* SRGBTable = bEncodeSRGB ? GetSRGBTable() : nullptr;
+	const VectorRegister4Float SRGBMin = VectorSetFloat1(FMath::AsFloat(SRGBTableMinBits));
+	const VectorRegister4Float SRGBMax = VectorSetFloat1(FMath::AsFloat(SRGBTableMaxBits));
+	const VectorRegister4Int SRGBMinBits = VectorIntSet1(int32(SRGBTableMinBits));
+
+	auto EncodeLinearChannel = [&](const VectorRegister4Float& Value)
+	{
+		return VectorFloatToInt(VectorMultiply(VectorMin(VectorMax(Value, Zero), One), Scale));
+	};
+
+	auto EncodeSRGBChannel = [&](const VectorRegister4Float& Value)
+	{
+		const VectorRegister4Int Bits = VectorCastFloatToInt(VectorMin(VectorMax(Value, SRGBMin), SRGBMax));
+		alignas(16) int32 Index[4];
+		VectorIntStoreAligned(VectorShiftRightImmLogical(VectorIntSubtract(Bits, SRGBMinBits), SRGBTableShift), Index);
+		return MakeVectorRegisterInt(SRGBTable[Index[0]], SRGBTable[Index[1]], SRGBTable[Index[2]], SRGBTable[Index[3]]);
+	};
+
+	// Structure of arrays: one register per channel holds four consecutive texels,
+	// packed into four FColors (B, G, R, A from the lowest byte) with a single store.
+	int32 x = Begin;
+	VectorRegister4Float X = MakeVectorRegisterFloat(float(x), float(x + 1), float(x + 2), float(x + 3));
+	for (; x + 4 <= End; x += 4, X = VectorAdd(X, Four))
+	{
+		// Same operation order as FColorRampTexelMapping::GetTime.
+		const VectorRegister4Float Time = VectorMultiply(VectorAdd(X, OffsetV), StepV);
+		const VectorRegister4Float Progress = VectorMultiply(VectorSubtract(Time, StartV), InvSpanV);
+
+		VectorRegister4Float Value[4];
+		for (int32 Channel = 0; Channel < 4; ++Channel)
+		{
+			Value[Channel] = VectorAdd(ColorV[Channel], VectorMultiply(DeltaV[Channel], Progress));
+		}
+
+		// Alpha is never sRGB encoded.
+		const VectorRegister4Int R = SRGBTable ? EncodeSRGBChannel(Value[0]) : EncodeLinearChannel(Value[0]);
+		const VectorRegister4Int G = SRGBTable ? EncodeSRGBChannel(Value[1]) : EncodeLinearChannel(Value[1]);
+		const VectorRegister4Int B = SRGBTable ? EncodeSRGBChannel(Value[2]) : EncodeLinearChannel(Value[2]);
+		const VectorRegister4Int A = EncodeLinearChannel(Value[3]);
+
+		const VectorRegister4Int Packed = VectorIntOr(VectorIntOr(B, VectorShiftLeftImm(G, 8)), VectorIntOr(VectorShiftLeftImm(R, 16), VectorShiftLeftImm(A, 24)));
+		VectorIntStore(Packed, &OutTexels[x]);
+	}
+
+	for (; x < End; ++x)
+	{
+		OutTexels[x] = Shade(Segment, Mapping.GetTime(x));
+	}
+}
+
+void FColorRampTexels::BakeCurve(const UCurveLinearColor* Curve, int32 Width, EPixelFormat Format, uint8* OutPixels)
+{
+	for (int32 x = 0; x < Width; x++)
+	{
+		FLinearColor Color = IsValid(Curve) ? Curve->GetLinearColorValue(float(x) / float(Width)) : FLinearColor::Black;
+		Color.A = 1.f;
+
+		if (Format == PF_G8)
+		{
+			OutPixels[x] = Color.ToFColor(true).R;
+		}
+		else if (Format == PF_FloatRGBA)
+		{
+			reinterpret_cast<FFloat16Color*>(OutPixels)[x] = FFloat16Color(FColorRampEvaluator::EncodeLinear(Color, true));
+		}
+		else
+		{
+			reinterpret_cast<FColor*>(OutPixels)[x] = Color.ToFColor(true);
+		}
+	}
+}
+
+void FColorRampTexels::UploadTexelSpan(UTexture2D* Texture, int32 Row, int32 Begin, int32 End, int32 BytesPerTexel, const uint8* SpanPixels)
+{
+	if (!Texture->GetResource())
+	{
+		Texture->UpdateResource();
+		return;
+	}
+
+	// Freed by the render thread once uploaded.
+	const int32 NumBytes = (End - Begin) * BytesPerTexel;
+	FUpdateTextureRegion2D* Region = new FUpdateTextureRegion2D(Begin, Row, 0, 0, End - Begin, 1);
+	uint8* RegionPixels = static_cast<uint8*>(FMemory::Malloc(NumBytes));
+	FMemory::Memcpy(RegionPixels, SpanPixels, NumBytes);
+	Texture->UpdateTextureRegions(0, 1, Region, NumBytes, BytesPerTexel, RegionPixels,
+		[](uint8* SrcData, const FUpdateTextureRegion2D* Regions)
+		{
+			FMemory::Free(SrcData);
+			delete Regions;
+		});
+}
@@ -0,0 +1,3 @@
+﻿#include "Modules/ModuleManager.h"
+
+IMPLEMENT_MODULE(FDefaultModuleImpl, ColorRampRuntime)
@@ -0,0 +1,141 @@
+﻿#include "ColorRampEvaluator.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace ColorRampEvaluatorTest
+{
+	// Texel the ramp should hold at Time, written from the stops alone with the engine's encode.
+	static FColor ReferenceTexel(const TArray<FGradientColorPos>& Stops, EColorRampType RampType, bool bSRGB, float Time)
+	{
+		if (Time <= Stops[0].Position)
+		{
+			return Stops[0].Color.ToFColor(bSRGB);
+		}
+
+		if (Time > Stops.Last().Position)
+		{
+			return Stops.Last().Color.ToFColor(bSRGB);
+		}
+
+		// Segment (From, To] holding Time, stops sharing a position leave no segment in between.
+		int32 To = 1;
+		while (Stops[To].Position < Time)
+		{
+			++To;
+		}
+		const FGradientColorPos& From = Stops[To - 1];
+
+		if (RampType == CRT_CONSTANT)
+		{
+			return From.Color.ToFColor(bSRGB);
+		}
+
+		const float Progress = (Time - From.Position) * (1.f / (Stops[To].Position - From.Position));
+		FLinearColor Color;
+		for (int32 Channel = 0; Channel < 4; ++Channel)
+		{
+			const float Step = (Stops[To].Color.Component(Channel) - From.Color.Component(Channel)) * Progress;
+			Color.Component(Channel) = From.Color.Component(Channel) + Step;
+		}
+		return Color.ToFColor(bSRGB);
+	}
+
+	static TArray<FGradientColorPos> MakeStops(FRandomStream& Random, int32 NumStops)
+	{
+		TArray<FGradientColorPos> Stops;
+		for (int32 i = 0; i < NumStops; ++i)
+		{
+			FGradientColorPos& Stop = Stops.AddDefaulted_GetRef();
+			// Coarse positions so some stops share one, colors reach past one and into the linear sRGB toe.
+			Stop.Position = float(Random.RandRange(0, 16)) / 16.f;
+			Stop.Color = FLinearColor(Random.FRandRange(0.f, 1.2f), Random.FRandRange(0.f, 0.01f), Random.FRand(), Random.FRand());
+		}
+		Stops.StableSort([](const FGradientColorPos& A, const FGradientColorPos& B) { return A.Position < B.Position; });
+		return Stops;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FColorRampEvaluatorBakeTest, "Plugins.ColorRamp.Evaluator.Bake", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FColorRampEvaluatorBakeTest::RunTest(const FString& Parameters)
+{
+	using namespace ColorRampEvaluatorTest;
+
+	IConsoleVariable* BakeSIMD = IConsoleManager::Get().FindConsoleVariable(TEXT("ColorRamp.BakeSIMD"));
+	const bool bWasSIMD = BakeSIMD->GetBool();
+
+	FRandomStream Random(0x52414D50);
+	const int32 StopCounts[] = { 1, 2, 3, 8, 33 };
+	const int32 Widths[] = { 1, 7, 256, 9001 };
+	const EColorRampType RampTypes[] = { CRT_LINEAR, CRT_CONSTANT };
+
+	for (int32 NumStops : StopCounts)
+	{
+		const TArray<FGradientColorPos> Stops = MakeStops(Random, NumStops);
+
+		for (EColorRampType RampType : RampTypes)
+		{
+			for (bool bSRGB : { false, true })
+			{
+				const FColorRampEvaluator Evaluator(Stops, RampType, bSRGB);
+
+				for (int32 Width : Widths)
+				{
+					const FColorRampTexelMapping Mappings[] = { FColorRampTexelMapping::Start(Width), FColorRampTexelMapping::Ends(Width), FColorRampTexelMapping::Centers(Width) };
+					for (const FColorRampTexelMapping& Mapping : Mappings)
+					{
+						TArray<FColor> Expected;
+						Expected.SetNumUninitialized(Width);
+						for (int32 x = 0; x < Width; ++x)
+						{
+							Expected[x] = ReferenceTexel(Stops, RampType, bSRGB, Mapping.GetTime(x));
+						}
+
+						const FString Context = FString::Printf(TEXT("%d stops, %s, sRGB %d, width %d, offset %g"),
+							NumStops, RampType == CRT_LINEAR ? TEXT("linear") : TEXT("constant"), bSRGB, Width, Mapping.Offset);
+
+						TArray<FColor> Texels;
+						Texels.Init(FColor(0, 0, 0, 0), Width);
+						Evaluator.BakeScalar(Width, Mapping, Texels.GetData());
+						TestTrue(FString::Printf(TEXT("Scalar bake matches the reference (%s)"), *Context), Texels == Expected);
+
+						for (bool bSIMD : { false, true })
+						{
+							BakeSIMD->Set(bSIMD, ECVF_SetByCode);
+
+							Texels.Init(FColor(0, 0, 0, 0), Width);
+							Evaluator.Bake(Width, Mapping, Texels.GetData());
+							TestTrue(FString::Printf(TEXT("Bake with SIMD %d matches the reference (%s)"), bSIMD, *Context), Texels == Expected);
+
+							// A span leaves the texels around it untouched.
+							const int32 Begin = Width / 3;
+							const int32 End = Width - Width / 4;
+							Texels.Init(FColor(0, 0, 0, 0), Width);
+							Evaluator.BakeSpan(Begin, End, Mapping, Texels.GetData());
+							bool bSpanMatches = true;
+							for (int32 x = 0; x < Width; ++x)
+							{
+								bSpanMatches &= Texels[x] == (x >= Begin && x < End ? Expected[x] : FColor(0, 0, 0, 0));
+							}
+							TestTrue(FString::Printf(TEXT("Span bake with SIMD %d matches the reference (%s)"), bSIMD, *Context), bSpanMatches);
+						}
+
+						for (int32 x = 0; x < Width; x += FMath::Max(Width / 16, 1))
+						{
+							TestEqual(FString::Printf(TEXT("Evaluate matches texel %d (%s)"), x, *Context), Evaluator.Evaluate(Mapping.GetTime(x)), Expected[x]);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	BakeSIMD->Set(bWasSIMD, ECVF_SetByCode);
+	return true;
+}
+
+#endif
@@ -0,0 +1,102 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "ColorRampTypes.h"
+
+#include "ColorRampAtlas.generated.h"
+
+class UCurveLinearColor;
+class UMaterialInstanceDynamic;
+class UTexture2D;
+
+/**
+ * Runtime texture of ramps, one per row, rewritten without recompiling the materials sampling it.
+ * Bound to the texture parameter of a parameter ColorRamp node, with the row fed to its Row input,
+ * so many material instances share one texture and each animates its own row.
+ *
+ * Rows are BGRA8 and bilinear filtered, texel x of a row holds the ramp at x / Width.
+ * Only the rows that change are uploaded.
+ */
+UCLASS(BlueprintType)
+class COLORRAMPRUNTIME_API UColorRampAtlas : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * Creates an atlas with every row black.
+	 *
+	 * @param Outer		Owner of the atlas, the transient package if null
+	 * @param Width		Texels per row
+	 * @param NumRows	Number of ramps held
+	 */
+	UFUNCTION(BlueprintCallable, Category=ColorRamp, meta=(AdvancedDisplay = "Width,NumRows"))
+	static UColorRampAtlas* CreateColorRampAtlas(UObject* Outer, int32 Width = 256, int32 NumRows = 64);
+
+	/** Texture to bind to the texture parameter of a ColorRamp node. */
+	UFUNCTION(BlueprintPure, Category=ColorRamp)
+	UTexture2D* GetTexture() const { return Texture; }
+
+	UFUNCTION(BlueprintPure, Category=ColorRamp)
+	int32 GetWidth() const { return Width; }
+
+	UFUNCTION(BlueprintPure, Category=ColorRamp)
+	int32 GetNumRows() const { return NumRows; }
+
+	/** Reserves a free row, INDEX_NONE if all rows are in use. */
+	UFUNCTION(BlueprintCallable, Category=ColorRamp)
+	int32 AllocateRow();
+
+	/** Returns a row reserved by AllocateRow. Its texels are kept until it is set again. */
+	UFUNCTION(BlueprintCallable, Category=ColorRamp)
+	void FreeRow(int32 Row);
+
+	/**
+	 * Bakes stops into a row, encoded like a ColorRamp node with the same settings.
+	 *
+	 * @param Stops		Stops of the ramp, need not be sorted
+	 * @param RampType	Interpolation between stops
+	 * @param bSRGB		Same as the sRGB flag of the node
+	 */
+	UFUNCTION(BlueprintCallable, Category=ColorRamp)
+	void SetRowStops(int32 Row, const TArray<FGradientColorPos>& Stops, TEnumAsByte<EColorRampType> RampType, bool bSRGB = false);
+
+	/** Bakes a color curve into a row, encoded like a ColorRamp node using it as custom curve. */
+	UFUNCTION(BlueprintCallable, Category=ColorRamp)
+	void SetRowCurve(int32 Row, UCurveLinearColor* Curve);
+
+	/** Writes the blend of rows A and B into Row, Alpha 0 being A. Row may be A or B. */
+	UFUNCTION(BlueprintCallable, Category=ColorRamp)
+	void BlendRows(int32 Row, int32 RowA, int32 RowB, float Alpha);
+
+	/**
+	 * Points a material instance at a row of the atlas.
+	 *
+	 * @param TextureParameterName	Parameter name of the ColorRamp node
+	 * @param RowParameterName		Scalar parameter feeding the Row input of the node
+	 */
+	UFUNCTION(BlueprintCallable, Category=ColorRamp)
+	void BindRow(UMaterialInstanceDynamic* Instance, FName TextureParameterName, FName RowParameterName, int32 Row) const;
+
+private:
+	bool IsValidRow(int32 Row) const { return Row >= 0 && Row < NumRows; }
+
+	FColor* GetRowTexels(int32 Row) { return Texels.GetData() + Row * Width; }
+
+	// Copies a row into the platform data, which a recreated resource is built from, then queues the upload
+	// of that row. Creates the resource from the platform data if there is none yet.
+	void UploadRow(int32 Row);
+
+	UPROPERTY(Transient)
+	TObjectPtr<UTexture2D> Texture;
+
+	int32 Width = 0;
+	int32 NumRows = 0;
+
+	// CPU copy of the texels, rows are blended from it.
+	TArray<FColor> Texels;
+
+	// Rows handed out by AllocateRow.
+	TBitArray<> UsedRows;
+};
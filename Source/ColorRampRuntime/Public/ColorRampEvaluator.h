@@ -0,0 +1,121 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "PixelFormat.h"
+#include "ColorRampTypes.h"
+
+class UCurveLinearColor;
+class UTexture2D;
+
+/** Time held by each texel of a baked ramp, Time = (x + Offset) * Step. */
+struct FColorRampTexelMapping
+{
+	float Offset = 0.f;
+	float Step = 1.f;
+
+	/** Texel x holds x / Width. Used by ramps with a fixed resolution. */
+	static FColorRampTexelMapping Start(int32 Width) { return { 0.f, 1.f / float(Width) }; }
+
+	/** The first and last texel hold the ends of the ramp. Linear ramps filter exactly once the sample coordinate is remapped. */
+	static FColorRampTexelMapping Ends(int32 Width) { return { 0.f, 1.f / float(FMath::Max(Width - 1, 1)) }; }
+
+	/** Texel x holds its center, (x + 0.5) / Width. Constant ramps sample exactly with nearest filtering once stops lie on texel edges. */
+	static FColorRampTexelMapping Centers(int32 Width) { return { 0.5f, 1.f / float(Width) }; }
+
+	FORCEINLINE float GetTime(int32 x) const
+	{
+		const float X = float(x) + Offset;
+		return X * Step;
+	}
+};
+
+/**
+ * Segment table built once from sorted ramp stops.
+ * Baking sweeps the segments forward, random access is a binary search.
+ */
+class COLORRAMPRUNTIME_API FColorRampEvaluator
+{
+public:
+	/**
+	 * @param SortedStops	Stops ordered by position
+	 * @param InRampType	Interpolation between stops
+	 * @param bInEncodeSRGB	If true texels are sRGB encoded
+	 */
+	FColorRampEvaluator(TArrayView<const FGradientColorPos> SortedStops, EColorRampType InRampType, bool bInEncodeSRGB);
+
+	/** Color at Time. Values before the first stop or after the last one clamp to the end colors. */
+	FColor Evaluate(float Time) const;
+
+	/**
+	 * Fills Width texels, texel x holds the color at Mapping.GetTime(x). Uses the vector kernel unless ColorRamp.BakeSIMD is 0.
+	 * Wide ramps are baked in chunks across worker threads.
+	 */
+	void Bake(int32 Width, const FColorRampTexelMapping& Mapping, FColor* OutTexels) const;
+
+	/** Like Bake, but only fills texels [Begin, End). OutTexels still points at texel 0. */
+	void BakeSpan(int32 Begin, int32 End, const FColorRampTexelMapping& Mapping, FColor* OutTexels) const;
+
+	/** Reference implementation of Bake, one texel at a time on the calling thread. */
+	void BakeScalar(int32 Width, const FColorRampTexelMapping& Mapping, FColor* OutTexels) const;
+
+	/** Color at Time for float textures. Encoded like Evaluate, but neither quantized nor clamped above one. */
+	FLinearColor EvaluateLinear(float Time) const;
+
+	/** Fills float texels [Begin, End), texel x holds EvaluateLinear(Mapping.GetTime(x)). OutTexels points at texel 0. */
+	void BakeLinear(int32 Begin, int32 End, const FColorRampTexelMapping& Mapping, FLinearColor* OutTexels) const;
+
+	/** Encodes Color the way EvaluateLinear does. Alpha is kept as is. */
+	static FLinearColor EncodeLinear(const FLinearColor& Color, bool bEncodeSRGB);
+
+private:
+	struct FSegment
+	{
+		float Start;
+		float End;
+		float InvSpan;
+		FLinearColor Color;
+		FLinearColor Delta;
+		FColor ConstantTexel;
+	};
+
+	FColor Shade(const FSegment& Segment, float Time) const;
+	FLinearColor ShadeLinear(const FSegment& Segment, float Time) const;
+
+	/** Bakes texels [Begin, End) of a ramp. */
+	void BakeRange(const FColorRampTexelMapping& Mapping, int32 Begin, int32 End, FColor* OutTexels) const;
+	void BakeScalarRange(const FColorRampTexelMapping& Mapping, int32 Begin, int32 End, FColor* OutTexels) const;
+
+	/** Bakes the linear texels [Begin, End) of a segment four at a time. */
+	void BakeSegmentVectorized(const FSegment& Segment, const FColorRampTexelMapping& Mapping, int32 Begin, int32 End, FColor* OutTexels) const;
+
+	/** Segments with a non empty (Start, End] range, in order. */
+	TArray<FSegment> Segments;
+
+	float FirstPosition = 0.f;
+	float LastPosition = 0.f;
+	FColor FirstTexel = FColor::Black;
+	FColor LastTexel = FColor::Black;
+	FLinearColor FirstColor = FLinearColor::Black;
+	FLinearColor LastColor = FLinearColor::Black;
+
+	EColorRampType RampType;
+	bool bEncodeSRGB;
+};
+
+/** Texel work shared by the ramp textures of the nodes and UColorRampAtlas. */
+struct COLORRAMPRUNTIME_API FColorRampTexels
+{
+	/**
+	 * Bakes a custom curve, texel x holds the curve at x / Width. Custom curves are always sRGB encoded and opaque.
+	 *
+	 * @param Curve		Curve to sample, an invalid curve bakes black
+	 * @param Format	PF_B8G8R8A8, PF_G8 keeping the red channel, or PF_FloatRGBA
+	 */
+	static void BakeCurve(const UCurveLinearColor* Curve, int32 Width, EPixelFormat Format, uint8* OutPixels);
+
+	/**
+	 * Uploads texels [Begin, End) of a row to the resource of Texture, or creates the resource from the
+	 * platform data if there is none yet. The texels are copied, SpanPixels holds texel Begin.
+	 */
+	static void UploadTexelSpan(UTexture2D* Texture, int32 Row, int32 Begin, int32 End, int32 BytesPerTexel, const uint8* SpanPixels);
+};
@@ -0,0 +1,33 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+#include "ColorRampTypes.generated.h"
+
+UENUM(BlueprintType)
+enum EColorRampType
+{
+	CRT_LINEAR		UMETA(DisplayName = "Linear"),
+	CRT_CONSTANT	UMETA(DisplayName = "Constant")
+};
+
+USTRUCT(BlueprintType)
+struct FGradientColorPos
+{
+	GENERATED_BODY()
+
+	FGradientColorPos() : Color(FLinearColor(1, 1, 1, 1)), Position(0.f) {}
+
+	FGradientColorPos(FLinearColor InColor, float InPosition) : Color(InColor), Position(InPosition) {}
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=ColorRamp)
+	FLinearColor Color;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=ColorRamp, meta=(ClampMax=1, ClampMin=0, UIMax=1, UIMin=0))
+	float Position;
+
+	FORCEINLINE bool operator<(const FGradientColorPos& OtherPos) const
+	{
+		return Position < OtherPos.Position;
+	}
+};